@@ -0,0 +1,163 @@
+#define STB_IMAGE_RESIZE2_IMPLEMENTATION
+
+#include <benchmark/benchmark.h>
+#include "fixtures.hpp"
+#include "framequality.hpp"
+#include "resize.hpp"
+#include "stb_image_resize2.h"
+#include <cstring>
+#include <vector>
+
+static void BM_ImageBuffer_resizeTo(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(frame->resizeTo(300, 300));
+
+    state.SetBytesProcessed(state.iterations() * frame->getSize());
+}
+
+static void BM_ImageBuffer_cropImage(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(frame->cropImage(0.25, 0.2, 0.75, 0.8));
+
+    state.SetBytesProcessed(state.iterations() * frame->getSize() / 4);
+}
+
+// stb_image_resize2 at the same size, to compare against `resizeTo`.
+static void BM_resize_stb(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+    const auto &format = frame->getFormat();
+    auto input = static_cast<const unsigned char *>(frame->getData());
+    std::vector<unsigned char> output(300 * 300 * format.bytesPerPixel());
+
+    for (auto _ : state)
+    {
+        if (format.layout == PixelLayout::RGB24)
+            stbir_resize_uint8_srgb(input, format.width, format.height, format.width * 3, output.data(), 300, 300, 300 * 3, STBIR_RGB);
+        else
+            stbir_resize_uint8_linear(input, format.width, format.height, format.width, output.data(), 300, 300, 300, STBIR_1CHANNEL);
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+
+static void BM_resize_cv(benchmark::State &state)
+{
+    cv::Mat frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)))->to_mat();
+    cv::Mat output;
+
+    for (auto _ : state)
+        cv::resize(frame, output, cv::Size(300, 300));
+}
+
+static void BM_resize_into(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+    auto filter = static_cast<ResizeFilter>(state.range(2));
+    auto kernel = static_cast<ResizeKernel>(state.range(3));
+    if (kernel > bestResizeKernel())
+    {
+        state.SkipWithError("Kernel is not supported on this CPU");
+        return;
+    }
+
+    size_t stride = 300 * frame->getFormat().bytesPerPixel();
+    std::vector<char> output(300 * stride);
+
+    for (auto _ : state)
+    {
+        resize_into(frame->view(), output.data(), 300, 300, stride, filter, kernel);
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+
+static void BM_frame_quality(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+    auto kernel = static_cast<QualityKernel>(state.range(2));
+    if (kernel > bestQualityKernel())
+    {
+        state.SkipWithError("Kernel is not supported on this CPU");
+        return;
+    }
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(FrameQuality::measure(frame->view(), kernel));
+}
+
+// Copies one pixel at a time, to compare against the row copies of `cropImage`.
+static std::unique_ptr<ImageBuffer> crop_per_pixel(const ImageBuffer &image, double x0, double y0, double x1, double y1)
+{
+    const auto &format = image.getFormat();
+    unsigned int start_x = x0 * format.width, start_y = y0 * format.height;
+    unsigned int end_x = x1 * format.width, end_y = y1 * format.height;
+    unsigned int bpp = format.bytesPerPixel();
+
+    ImageFormat cropped = format;
+    cropped.width = end_x - start_x;
+    cropped.height = end_y - start_y;
+    cropped.buffersize = cropped.width * cropped.height * bpp;
+
+    auto pixels = std::make_unique<char[]>(cropped.buffersize);
+    auto src = static_cast<const char *>(image.getData());
+    for (unsigned int y = start_y; y < end_y; y++)
+        for (unsigned int x = start_x; x < end_x; x++)
+            std::memcpy(pixels.get() + ((y - start_y) * cropped.width + (x - start_x)) * bpp,
+                        src + (y * format.width + x) * bpp, bpp);
+
+    return std::make_unique<ImageBuffer>(std::move(pixels), cropped.buffersize, cropped);
+}
+
+static void BM_crop_per_pixel(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(crop_per_pixel(*frame, 0.25, 0.2, 0.75, 0.8));
+
+    state.SetBytesProcessed(state.iterations() * frame->getSize() / 4);
+}
+
+static void BM_ImageBuffer_cropView(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(frame->cropView(0.25, 0.2, 0.75, 0.8));
+}
+
+static void BM_ImageBuffer_to_mat(benchmark::State &state)
+{
+    auto frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(frame->to_mat());
+
+    state.SetBytesProcessed(state.iterations() * frame->getSize());
+}
+
+BENCHMARK(BM_ImageBuffer_resizeTo)->FIXTURE_RESOLUTIONS->ArgNames({"width", "layout"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_resize_stb)->FIXTURE_RESOLUTIONS->ArgNames({"width", "layout"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_resize_cv)->FIXTURE_RESOLUTIONS->ArgNames({"width", "layout"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_resize_into)
+    ->ArgsProduct({{640, 1280},
+                   {static_cast<int>(PixelLayout::Grey), static_cast<int>(PixelLayout::RGB24)},
+                   {static_cast<int>(ResizeFilter::Bilinear), static_cast<int>(ResizeFilter::Area)},
+                   {static_cast<int>(ResizeKernel::Scalar), static_cast<int>(ResizeKernel::AVX2)}})
+    ->ArgNames({"width", "layout", "filter", "kernel"})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_frame_quality)
+    ->ArgsProduct({{640, 1280},
+                   {static_cast<int>(PixelLayout::Grey), static_cast<int>(PixelLayout::RGB24)},
+                   {static_cast<int>(QualityKernel::Scalar), static_cast<int>(QualityKernel::AVX2)}})
+    ->ArgNames({"width", "layout", "kernel"})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ImageBuffer_cropImage)->FIXTURE_RESOLUTIONS->ArgNames({"width", "layout"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_crop_per_pixel)->ArgsProduct({{1280}, {static_cast<int>(PixelLayout::Grey), static_cast<int>(PixelLayout::RGB24)}})->ArgNames({"width", "layout"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ImageBuffer_cropView)->FIXTURE_RESOLUTIONS->ArgNames({"width", "layout"})->Unit(benchmark::kNanosecond);
+BENCHMARK(BM_ImageBuffer_to_mat)->FIXTURE_RESOLUTIONS->ArgNames({"width", "layout"})->Unit(benchmark::kMicrosecond);
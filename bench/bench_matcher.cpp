@@ -0,0 +1,58 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include "matcher.hpp"
+#include "recognition.hpp"
+
+static cv::Mat random_embeddings(int rows)
+{
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist;
+
+    cv::Mat embeddings(rows, EMBEDDING_WIDTH, CV_32F);
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < EMBEDDING_WIDTH; j++)
+            embeddings.at<float>(i, j) = dist(rng);
+    return embeddings;
+}
+
+static void match(benchmark::State &state, MatcherKernel kernel)
+{
+    if (kernel > EmbeddingMatcher::bestKernel())
+    {
+        state.SkipWithError("Kernel is not supported on this CPU");
+        return;
+    }
+
+    EmbeddingMatcher matcher(random_embeddings(state.range(0)), kernel);
+    cv::Mat probe = random_embeddings(1);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(matcher.best(probe));
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The per-pair path used by are_similar(): cv::Mat::dot and two cv::norm calls.
+static void BM_Match_OpenCV(benchmark::State &state)
+{
+    cv::Mat enrolled = random_embeddings(state.range(0));
+    cv::Mat probe = random_embeddings(1);
+
+    for (auto _ : state)
+    {
+        float best = -1;
+        for (int i = 0; i < enrolled.rows; i++)
+        {
+            cv::Mat row = enrolled.row(i);
+            best = std::max(best, static_cast<float>(row.dot(probe) / (cv::norm(row) * cv::norm(probe))));
+        }
+        benchmark::DoNotOptimize(best);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_CAPTURE(match, Scalar, MatcherKernel::Scalar)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK_CAPTURE(match, AVX2, MatcherKernel::AVX2)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK_CAPTURE(match, AVX512, MatcherKernel::AVX512)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK(BM_Match_OpenCV)->RangeMultiplier(4)->Range(1, 256);
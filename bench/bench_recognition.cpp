@@ -0,0 +1,380 @@
+#include <benchmark/benchmark.h>
+#include "fixtures.hpp"
+#include "alignment.hpp"
+#include "facedetector.hpp"
+#include "facetracker.hpp"
+#include "modelregistry.hpp"
+#include "recognition.hpp"
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <thread>
+
+static void BM_extract_face(benchmark::State &state)
+{
+    if (!models_available())
+    {
+        state.SkipWithError("Models are not available, set IRPAM_MODEL_DIR");
+        return;
+    }
+
+    cv::Mat frame = fixture_frame(state.range(0), height_for(state.range(0)), static_cast<PixelLayout>(state.range(1)))->to_mat();
+    state.SetLabel(has_recorded_fixtures() ? "recorded" : "synthetic");
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(extract_face(frame));
+}
+
+// Face extraction over consecutive frames of a stream, detecting on every frame or
+// following the face with a FaceTracker.
+static void BM_stream_extract(benchmark::State &state)
+{
+    if (!models_available())
+    {
+        state.SkipWithError("Models are not available, set IRPAM_MODEL_DIR");
+        return;
+    }
+
+    bool tracked = state.range(0) != 0;
+    std::vector<cv::Mat> frames = recorded_frames(64);
+    if (frames.empty())
+        frames.push_back(fixture_frame(640, 480, PixelLayout::Grey)->to_mat());
+    state.SetLabel(has_recorded_fixtures() ? "recorded" : "synthetic");
+
+    FaceTracker tracker;
+    size_t frame = 0;
+    for (auto _ : state)
+    {
+        const cv::Mat &image = frames[frame++ % frames.size()];
+        // Replaying from the start is a jump, not a movement the tracker could follow.
+        if (frame % frames.size() == 1)
+            tracker.reset();
+        benchmark::DoNotOptimize(tracked ? tracker.extract(image) : extract_face(image));
+    }
+
+    if (tracked)
+    {
+        TrackerStats stats = tracker.getStats();
+        state.counters["full_detections"] = benchmark::Counter(stats.full_detections, benchmark::Counter::kAvgIterations);
+        state.counters["window_detections"] = benchmark::Counter(stats.window_detections, benchmark::Counter::kAvgIterations);
+        state.counters["template_matches"] = benchmark::Counter(stats.template_matches, benchmark::Counter::kAvgIterations);
+    }
+}
+
+static void BM_get_embedding(benchmark::State &state)
+{
+    if (!models_available())
+    {
+        state.SkipWithError("Models are not available, set IRPAM_MODEL_DIR");
+        return;
+    }
+
+    cv::Mat face = fixture_frame(EMBEDDING_NET_WIDTH, EMBEDDING_NET_WIDTH, PixelLayout::RGB24)->to_mat();
+    auto blob = cv::dnn::blobFromImage(face, 1.0 / 128.0, cv::Size(EMBEDDING_NET_WIDTH, EMBEDDING_NET_WIDTH));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(get_embedding(blob));
+}
+
+static void BM_are_similar(benchmark::State &state)
+{
+    if (!models_available())
+    {
+        state.SkipWithError("Models are not available, set IRPAM_MODEL_DIR");
+        return;
+    }
+
+    cv::Mat frame = fixture_frame(640, 480, PixelLayout::Grey)->to_mat();
+    cv::Mat face = extract_face(frame).value_or(frame);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(are_similar(face, face));
+}
+
+// Latency of one forward pass for 1..N inference threads. Items per second is the
+// throughput of a single authentication stream at that budget.
+static void forward_with_threads(benchmark::State &state, bool detector)
+{
+    if (!models_available())
+    {
+        state.SkipWithError("Models are not available, set IRPAM_MODEL_DIR");
+        return;
+    }
+
+    ModelRegistry &registry = ModelRegistry::getInstance();
+    registry.configureInference(InferenceConfig{.threads = static_cast<int>(state.range(0))});
+
+    ModelPaths paths = registry.getPaths();
+    const ModelSpec &spec = detector ? paths.detector : paths.embedder;
+    cv::Mat input = fixture_frame(spec.input_width, spec.input_height, PixelLayout::RGB24)->to_mat();
+    cv::Mat blob = spec.blobFromImages({input});
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(detector ? registry.detect(blob).front() : get_embedding(blob));
+
+    state.SetItemsProcessed(state.iterations());
+    registry.configureInference({});
+}
+
+static void BM_detect_threads(benchmark::State &state)
+{
+    forward_with_threads(state, true);
+}
+
+static void BM_embed_threads(benchmark::State &state)
+{
+    forward_with_threads(state, false);
+}
+
+// The largest face of every frame, as found by the detector the registry runs.
+static std::vector<std::optional<cv::Rect>> largest_faces(const FaceDetector &detector, const std::vector<cv::Mat> &frames)
+{
+    std::vector<std::optional<cv::Rect>> largest;
+    for (const auto &frame : frames)
+    {
+        auto faces = detector.detect(frame, 1);
+        largest.push_back(faces.empty() ? std::nullopt : std::optional(cv::Rect(faces[0].x, faces[0].y, faces[0].w, faces[0].h)));
+    }
+    return largest;
+}
+
+// Latency of every detector variant in the model manifest. On a recording, recall is
+// the share of the faces found by the first (reference) detector that the variant
+// finds as well, with an IoU of at least 0.5.
+static void BM_detector(benchmark::State &state)
+{
+    std::vector<ModelSpec> variants;
+    try
+    {
+        variants = ModelManifest::fromDirectory(ModelManifest::defaultDirectory()).variants(ModelRole::Detector);
+    }
+    catch (const std::exception &e)
+    {
+        state.SkipWithError(e.what());
+        return;
+    }
+    if (state.range(0) >= static_cast<int64_t>(variants.size()))
+    {
+        state.SkipWithError("No such detector in the model manifest");
+        return;
+    }
+
+    ModelRegistry &registry = ModelRegistry::getInstance();
+    ModelPaths configured = registry.getPaths();
+    auto use_detector = [&](const ModelSpec &spec)
+    {
+        registry.configure(ModelPaths{.detector = spec, .embedder = configured.embedder});
+        return FaceDetector::create(spec);
+    };
+
+    const ModelSpec &spec = variants[state.range(0)];
+    state.SetLabel(spec.name);
+    std::vector<cv::Mat> frames = recorded_frames(64);
+    if (frames.empty())
+        frames.push_back(fixture_frame(640, 480, PixelLayout::Grey)->to_mat());
+
+    try
+    {
+        if (has_recorded_fixtures())
+        {
+            auto reference = largest_faces(*use_detector(variants.front()), frames);
+            auto found = largest_faces(*use_detector(spec), frames);
+
+            int expected = 0;
+            int matched = 0;
+            for (size_t i = 0; i < frames.size(); i++)
+            {
+                if (!reference[i])
+                    continue;
+                expected++;
+                if (found[i])
+                {
+                    double overlap = (*reference[i] & *found[i]).area();
+                    matched += overlap / (reference[i]->area() + found[i]->area() - overlap) >= 0.5;
+                }
+            }
+            state.counters["recall"] = expected ? static_cast<double>(matched) / expected : 0;
+        }
+
+        auto detector = use_detector(spec);
+        registry.preload();
+        size_t frame = 0;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(detector->detect(frames[frame++ % frames.size()]));
+    }
+    catch (const std::exception &e)
+    {
+        state.SkipWithError(e.what());
+    }
+    registry.configure(configured);
+}
+
+static std::vector<DetectedFace> synthetic_detections(int count)
+{
+    // Clusters of four overlapping boxes, like a detector reports around each face.
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> jitter(-8, 8);
+    std::uniform_real_distribution<float> confidence(0.8f, 1.0f);
+
+    std::vector<DetectedFace> faces;
+    for (int i = 0; i < count; i++)
+    {
+        int cluster = i / 4;
+        int x = (cluster % 8) * 160 + jitter(rng);
+        int y = (cluster / 8) * 160 + jitter(rng);
+        int side = 100 + cluster % 5 * 10 + jitter(rng);
+        faces.push_back(DetectedFace{.x = x, .y = y, .w = side, .h = side, .size = side * side, .confidence = confidence(rng)});
+    }
+    return faces;
+}
+
+// The old post-processing of extract_face: a full sort by size, copying the faces
+// into the comparator, to take the first one.
+static void BM_largest_face_sort(benchmark::State &state)
+{
+    auto detections = synthetic_detections(state.range(0));
+    for (auto _ : state)
+    {
+        auto faces = detections;
+        std::sort(faces.begin(), faces.end(), [](DetectedFace face1, DetectedFace face2)
+                  { return face1.size > face2.size; });
+        benchmark::DoNotOptimize(faces.front());
+    }
+}
+
+// Non-maximum suppression over the most confident candidates, then a partial sort
+// for the largest remaining face.
+static void BM_largest_face_nms(benchmark::State &state)
+{
+    auto detections = synthetic_detections(state.range(0));
+    for (auto _ : state)
+    {
+        auto faces = non_max_suppression(detections, 0.3f);
+        keep_largest(faces, 1);
+        benchmark::DoNotOptimize(faces.front());
+    }
+}
+
+// Turning a detected face into the embedding input: the crop of its box, resized by
+// blobFromImage, against a single warp onto the ArcFace template.
+static void BM_face_input(benchmark::State &state)
+{
+    bool aligned = state.range(0) != 0;
+    cv::Mat frame = fixture_frame(640, 480, PixelLayout::Grey)->to_mat();
+    DetectedFace face{.x = 250, .y = 150, .w = 224, .h = 224, .size = 224 * 224, .confidence = 1};
+    for (const auto &point : ARCFACE_TEMPLATE)
+        face.landmarks.emplace_back(point.x * 2 + face.x, point.y * 2 + face.y);
+    state.SetLabel(aligned ? "aligned" : "crop+resize");
+
+    cv::Mat input;
+    for (auto _ : state)
+    {
+        if (aligned)
+            input = align_face(frame, face.landmarks, EMBEDDING_NET_WIDTH, EMBEDDING_NET_WIDTH);
+        else
+            cv::resize(crop_face(frame, face), input, cv::Size(EMBEDDING_NET_WIDTH, EMBEDDING_NET_WIDTH));
+        benchmark::DoNotOptimize(input.data);
+    }
+}
+
+// How far the faces of a recording score above the match threshold, against its first
+// face, with and without alignment. Needs a detector that finds landmarks, so this
+// runs the first YuNet model of the manifest. Time is per embedded face.
+static void BM_alignment_margin(benchmark::State &state)
+{
+    bool aligned = state.range(0) != 0;
+    state.SetLabel(aligned ? "aligned" : "crop");
+    std::vector<cv::Mat> frames = recorded_frames(64);
+    if (frames.empty())
+    {
+        state.SkipWithError("Needs a recording, set IRPAM_BENCH_FIXTURES");
+        return;
+    }
+
+    ModelManifest manifest = ModelManifest::fromDirectory(ModelManifest::defaultDirectory());
+    auto detectors = manifest.variants(ModelRole::Detector);
+    auto yunet = std::find_if(detectors.begin(), detectors.end(), [](const ModelSpec &spec)
+                              { return spec.decoder == "yunet"; });
+    if (yunet == detectors.end())
+    {
+        state.SkipWithError("No detector with landmarks in the model manifest");
+        return;
+    }
+
+    ModelRegistry &registry = ModelRegistry::getInstance();
+    ModelPaths configured = registry.getPaths();
+    try
+    {
+        registry.configure(ModelPaths{.detector = *yunet, .embedder = configured.embedder});
+        registry.preload();
+
+        std::vector<cv::Mat> faces;
+        for (const auto &frame : frames)
+        {
+            auto face = detect_face(frame);
+            if (face.has_value())
+                faces.push_back(aligned ? align_face(frame, face->landmarks, configured.embedder.input_width, configured.embedder.input_height)
+                                        : crop_face(frame, face.value()));
+        }
+        if (faces.size() < 2)
+            throw std::runtime_error("Too few faces in the recording");
+
+        cv::Mat enrolled = face_embedding(faces.front());
+        double total = 0;
+        double worst = 1;
+        for (size_t i = 1; i < faces.size(); i++)
+        {
+            double similarity = best_similarity(face_embedding(faces[i]), enrolled);
+            total += similarity;
+            worst = std::min(worst, similarity);
+        }
+        state.counters["margin"] = total / (faces.size() - 1) - face_threshold;
+        state.counters["worst_margin"] = worst - face_threshold;
+
+        size_t face = 0;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(face_embedding(faces[face++ % faces.size()]));
+    }
+    catch (const std::exception &e)
+    {
+        state.SkipWithError(e.what());
+    }
+    registry.configure(configured);
+}
+
+// One run per detector variant in the model manifest.
+static void detector_variants(benchmark::internal::Benchmark *benchmark)
+{
+    int variants = 1;
+    try
+    {
+        ModelManifest manifest = ModelManifest::fromDirectory(ModelManifest::defaultDirectory());
+        variants = std::max<int>(1, manifest.variants(ModelRole::Detector).size());
+    }
+    catch (const std::exception &)
+    {
+        // The single run reports why there is no detector.
+    }
+    benchmark->DenseRange(0, variants - 1);
+}
+
+static void thread_counts(benchmark::internal::Benchmark *benchmark)
+{
+    int cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= cpus; threads *= 2)
+        benchmark->Arg(threads);
+    if ((cpus & (cpus - 1)) != 0)
+        benchmark->Arg(cpus);
+}
+
+BENCHMARK(BM_extract_face)->FIXTURE_RESOLUTIONS->ArgNames({"width", "layout"})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_stream_extract)->Arg(0)->Arg(1)->ArgName("tracked")->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_get_embedding)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_are_similar)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_detector)->Apply(detector_variants)->ArgName("variant")->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_largest_face_sort)->Arg(8)->Arg(64)->Arg(200)->ArgName("detections");
+BENCHMARK(BM_largest_face_nms)->Arg(8)->Arg(64)->Arg(200)->ArgName("detections");
+BENCHMARK(BM_face_input)->Arg(0)->Arg(1)->ArgName("aligned");
+BENCHMARK(BM_alignment_margin)->Arg(0)->Arg(1)->ArgName("aligned")->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_detect_threads)->Apply(thread_counts)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_embed_threads)->Apply(thread_counts)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,107 @@
+#include <benchmark/benchmark.h>
+#include "fixtures.hpp"
+#include "modelregistry.hpp"
+#include "replaysource.hpp"
+#include <cstdlib>
+#include <random>
+#include <string>
+
+// Describe the build in the context of the results, to compare the build profiles.
+static const bool build_context = []()
+{
+    benchmark::AddCustomContext("irpam_build_profile", IRPAM_BUILD_PROFILE);
+    benchmark::AddCustomContext("opencv_version", CV_VERSION);
+    benchmark::AddCustomContext("opencv_parallel_framework", cv::currentParallelFramework() ? cv::currentParallelFramework() : "none");
+    benchmark::AddCustomContext("opencv_threads", std::to_string(cv::getNumThreads()));
+    benchmark::AddCustomContext("opencv_cpu_features", cv::getCPUFeaturesLine());
+    return true;
+}();
+
+static std::unique_ptr<ImageBuffer> recorded_frame()
+{
+    const char *path = std::getenv("IRPAM_BENCH_FIXTURES");
+    if (path == nullptr)
+        return nullptr;
+
+    static std::unique_ptr<ImageBuffer> frame = ReplaySource(path).open({})->next();
+    return std::make_unique<ImageBuffer>(frame->getData(), frame->getSize(), frame->getFormat());
+}
+
+bool has_recorded_fixtures()
+{
+    return std::getenv("IRPAM_BENCH_FIXTURES") != nullptr;
+}
+
+std::vector<cv::Mat> recorded_frames(size_t count)
+{
+    std::vector<cv::Mat> frames;
+    const char *path = std::getenv("IRPAM_BENCH_FIXTURES");
+    if (path == nullptr)
+        return frames;
+
+    auto stream = ReplaySource(path).open({});
+    try
+    {
+        while (frames.size() < count)
+            frames.push_back(stream->next()->to_mat().clone());
+    }
+    catch (const std::exception &)
+    {
+        // The recording is shorter than that.
+    }
+    return frames;
+}
+
+static cv::Mat synthetic_frame(unsigned int width, unsigned int height)
+{
+    // A smooth gradient with some noise on top, so resizers and the detector
+    // do not get to take shortcuts on flat input.
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> noise(-16, 16);
+
+    cv::Mat frame(height, width, CV_8UC3);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        auto row = frame.ptr<unsigned char>(y);
+        for (unsigned int x = 0; x < width * 3; x++)
+            row[x] = static_cast<unsigned char>(std::clamp<int>((x / 3 + y) * 255 / (width + height) + noise(rng), 0, 255));
+    }
+    return frame;
+}
+
+std::unique_ptr<ImageBuffer> fixture_frame(unsigned int width, unsigned int height, PixelLayout layout)
+{
+    cv::Mat frame;
+    auto recorded = recorded_frame();
+    if (recorded)
+    {
+        cv::resize(recorded->to_mat(), frame, cv::Size(width, height));
+        if (frame.depth() == CV_16U)
+            frame.convertTo(frame, CV_8U, 1.0 / 256.0);
+        if (frame.channels() == 1)
+            cv::cvtColor(frame, frame, cv::COLOR_GRAY2RGB);
+    }
+    else
+    {
+        frame = synthetic_frame(width, height);
+    }
+
+    if (layout == PixelLayout::Grey)
+        cv::cvtColor(frame, frame, cv::COLOR_RGB2GRAY);
+
+    auto format = ImageFormat::fromFourcc(layout == PixelLayout::Grey ? V4L2_PIX_FMT_GREY : V4L2_PIX_FMT_RGB24, width, height);
+    return std::make_unique<ImageBuffer>(frame.data, format.buffersize, format);
+}
+
+bool models_available()
+{
+    try
+    {
+        ModelRegistry::getInstance().preload();
+        return true;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
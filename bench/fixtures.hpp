@@ -0,0 +1,48 @@
+#ifndef BENCH_FIXTURES_HPP
+#define BENCH_FIXTURES_HPP
+
+#include <memory>
+#include <vector>
+
+#include "image.hpp"
+
+/**
+ * @brief Frames the benchmarks run on.
+ *
+ * If `IRPAM_BENCH_FIXTURES` points at a recording (a raw capture file or a
+ * directory of images, see `ReplaySource`), its first frame is used, scaled to
+ * the requested resolution. Otherwise a deterministic synthetic frame is used,
+ * which is good enough for the preprocessing stages but will not contain a face.
+ */
+std::unique_ptr<ImageBuffer> fixture_frame(unsigned int width, unsigned int height, PixelLayout layout);
+
+/**
+ * @brief Whether the fixture frames come from a real recording.
+ */
+bool has_recorded_fixtures();
+
+/**
+ * @brief Up to `count` consecutive frames of the recording, as they were captured.
+ * Empty without a recording.
+ */
+std::vector<cv::Mat> recorded_frames(size_t count);
+
+/**
+ * @brief Whether the DNN models can be loaded. Benchmarks that need them skip
+ * themselves when they cannot.
+ */
+bool models_available();
+
+/**
+ * @brief The height of the fixture frames of a width: 720p at 1280, 4:3 below.
+ */
+inline unsigned int height_for(int width)
+{
+    return width == 1280 ? 720 : width * 3 / 4;
+}
+
+// Resolutions every per-frame benchmark runs at: width (see `height_for()`), layout.
+#define FIXTURE_RESOLUTIONS                                        \
+    ArgsProduct({{320, 640, 1280}, {static_cast<int>(PixelLayout::Grey), static_cast<int>(PixelLayout::RGB24)}})
+
+#endif
@@ -0,0 +1,116 @@
+#include "authengine.hpp"
+#include "boundedqueue.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+AuthEngine::AuthEngine(const AuthConfig &config)
+    : config(config)
+{
+}
+
+/**
+ * Run one authentication attempt against the enrolled embeddings in the matcher.
+ *
+ * @returns The result of the attempt. Capture failures end the attempt early and
+ * are reported in `AuthResult::error` rather than thrown.
+ */
+AuthResult AuthEngine::authenticate(const FrameGrabber &grab, const EmbeddingMatcher &matcher) const
+{
+    TRACE_SCOPE("auth.authenticate");
+    AuthResult result;
+    auto start = Clock::now();
+    auto deadline = start + config.deadline;
+
+    BoundedQueue<std::unique_ptr<ImageBuffer>> queue(config.queue_depth);
+    std::atomic<bool> stop = false;
+    std::atomic<int> captured = 0;
+    std::atomic<int> stale = 0;
+    std::mutex error_lock;
+    std::string capture_error;
+
+    std::thread capture([&]()
+                        {
+        try
+        {
+            while (!stop && Clock::now() < deadline)
+            {
+                if (config.max_frames > 0 && captured >= config.max_frames)
+                    break;
+
+                auto frame = grab(deadline);
+                if (!frame)
+                    continue;
+
+                // Never authenticate on a picture taken before the attempt was asked for.
+                if (frame->getCaptureTime() < config.not_before)
+                {
+                    stale++;
+                    continue;
+                }
+
+                captured++;
+                queue.push(std::move(frame));
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::lock_guard guard(error_lock);
+            capture_error = e.what();
+        }
+        // Nothing else is coming, let the inference side drain what is left and finish.
+        queue.close(); });
+
+    // Frames of one attempt come from one stream, so the face is tracked across them.
+    FaceTracker tracker(config.tracking);
+    FrameQualityGate gate(config.quality);
+    try
+    {
+        while (auto frame = queue.pop_until(deadline))
+        {
+            TRACE_SCOPE("auth.frame");
+            result.frames_processed++;
+
+            // A few microseconds here saves detection and embedding on frames that cannot match.
+            if (gate.judge(**frame) != FrameVerdict::Usable)
+                continue;
+
+            // The frame outlives the face cut from it, so a view will do.
+            auto face = tracker.extract((*frame)->view().as_mat());
+            if (!face.has_value())
+                continue;
+
+            result.faces_found++;
+            MatchResult match = matcher.best(face_embedding(face.value()));
+            result.best_score = std::max(result.best_score, match.score);
+
+            if (match.score >= config.threshold)
+            {
+                result.matched = true;
+                break;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        result.error = e.what();
+    }
+
+    stop = true;
+    queue.close();
+    capture.join();
+
+    result.tracking = tracker.getStats();
+    result.frames_rejected = gate.rejected();
+    result.verdicts = gate.getCounts();
+    result.frames_captured = captured;
+    result.frames_stale = stale;
+    result.frames_dropped = static_cast<int>(queue.droppedCount());
+    result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    if (result.error.empty())
+        result.error = capture_error;
+    return result;
+}
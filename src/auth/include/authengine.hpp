@@ -0,0 +1,84 @@
+#ifndef AUTH_ENGINE_HPP
+#define AUTH_ENGINE_HPP
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "image.hpp"
+#include "facetracker.hpp"
+#include "framequality.hpp"
+#include "matcher.hpp"
+#include "recognition.hpp"
+
+/**
+ * @brief Knobs of a single authentication attempt.
+ */
+struct AuthConfig
+{
+    // Give up once this much time has passed since the attempt started.
+    std::chrono::milliseconds deadline{3000};
+    // Minimum cosine similarity to an enrolled embedding for a frame to match.
+    float threshold = face_threshold;
+    // Frames waiting for inference. Older frames are dropped when it is full.
+    size_t queue_depth = 2;
+    // Stop capturing after this many frames. Zero captures until the deadline.
+    int max_frames = 0;
+    // Frames captured before this point are stale, e.g. left in the driver's ring
+    // since an earlier attempt, and are dropped. The default keeps every frame.
+    std::chrono::steady_clock::time_point not_before{};
+    // How the face is followed from frame to frame, to skip full frame detections.
+    TrackerConfig tracking;
+    // Which frames are not worth running the detector on.
+    QualityConfig quality;
+};
+
+/**
+ * @brief Outcome of an authentication attempt.
+ */
+struct AuthResult
+{
+    bool matched = false;
+    float best_score = -1;
+    int frames_captured = 0;
+    int frames_processed = 0;
+    int frames_dropped = 0;
+    // Frames captured before `AuthConfig::not_before`, dropped unseen.
+    int frames_stale = 0;
+    int faces_found = 0;
+    // Frames the quality gate turned away before detection, and the verdicts on all frames.
+    int frames_rejected = 0;
+    VerdictCounts verdicts = {};
+    TrackerStats tracking;
+    std::chrono::milliseconds elapsed{0};
+    std::string error;
+};
+
+/**
+ * @brief Produces the next frame to authenticate with, waiting no longer than the
+ * deadline of the attempt it is given. Returning `nullptr` means no frame was
+ * available this time; throwing ends capturing.
+ */
+using FrameGrabber = std::function<std::unique_ptr<ImageBuffer>(std::chrono::steady_clock::time_point deadline)>;
+
+/**
+ * @brief Multi-frame authentication with early exit.
+ *
+ * Frames are captured on a dedicated thread and handed to the calling thread
+ * through a small bounded queue, so the camera delivers the next frame while
+ * the current one goes through detection and embedding. The attempt stops as
+ * soon as a frame matches, or when the deadline expires.
+ */
+class AuthEngine
+{
+private:
+    AuthConfig config;
+
+public:
+    explicit AuthEngine(const AuthConfig &config = {});
+
+    AuthResult authenticate(const FrameGrabber &grab, const EmbeddingMatcher &matcher) const;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+/**
+ * @brief A small thread-safe queue with a fixed capacity, used to hand frames from
+ * the capture thread to the inference thread.
+ *
+ * When the queue is full, pushing drops the oldest element instead of blocking:
+ * a live camera keeps producing frames, and the consumer always wants the freshest one.
+ * Closing the queue wakes up every waiting consumer.
+ */
+template <typename T>
+class BoundedQueue
+{
+private:
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+    size_t dropped = 0;
+    mutable std::mutex lock;
+    std::condition_variable available;
+
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    /**
+     * Add an element, dropping the oldest one if the queue is full.
+     *
+     * @returns `false` if the queue was closed and the element was discarded.
+     */
+    bool push(T item)
+    {
+        {
+            std::lock_guard guard(lock);
+            if (closed)
+                return false;
+
+            if (items.size() >= capacity)
+            {
+                items.pop_front();
+                dropped++;
+            }
+            items.push_back(std::move(item));
+        }
+        available.notify_one();
+        return true;
+    }
+
+    /**
+     * Take the oldest element, waiting until the deadline for one to arrive.
+     *
+     * @returns The element, or nothing if the deadline passed or the queue was
+     * closed and drained.
+     */
+    template <typename Clock, typename Duration>
+    std::optional<T> pop_until(const std::chrono::time_point<Clock, Duration> &deadline)
+    {
+        std::unique_lock guard(lock);
+        if (!available.wait_until(guard, deadline, [this]
+                                  { return closed || !items.empty(); }))
+            return std::nullopt;
+
+        if (items.empty())
+            return std::nullopt;
+
+        T item = std::move(items.front());
+        items.pop_front();
+        return item;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard guard(lock);
+            closed = true;
+        }
+        available.notify_all();
+    }
+
+    size_t droppedCount() const
+    {
+        std::lock_guard guard(lock);
+        return dropped;
+    }
+};
+
+#endif
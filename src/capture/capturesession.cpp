@@ -0,0 +1,414 @@
+#include "capturesession.hpp"
+#include "spdlog/spdlog.h"
+#include "trace.hpp"
+#include <poll.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#define BUF_REQ_COUNT 10
+
+/**
+ * Open a streaming session on the device for the given image format.
+ *
+ * The format is only a suggestion to the driver; the negotiated format is read
+ * back after VIDIOC_S_FMT and used for the lifetime of the session. All buffers
+ * are mapped and queued, and the stream is started before the constructor returns.
+ */
+CaptureSession::CaptureSession(int fd, const ImageFormat &requested, bool is_ir)
+    : fd(fd), warmup(WarmupConfig{.require_stable = !is_ir})
+{
+    TRACE_SCOPE("capture.start_session");
+
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = requested.width;
+    fmt.fmt.pix.height = requested.height;
+    fmt.fmt.pix.pixelformat = requested.fourcc;
+    fmt.fmt.pix.field = V4L2_FIELD_ANY;
+
+    if (v4l2_ioctl(fd, VIDIOC_S_FMT, &fmt) < 0)
+    {
+        throw std::runtime_error("Could not set format: " + std::string(strerror(errno)));
+    }
+
+    struct v4l2_requestbuffers req = {};
+    // If we are working with IR cameras, we need a bunch of frames before
+    // we can actually get data (probably). Since RGB cameras normally have FPS ~15+
+    // this should not impact them?.
+    req.count = BUF_REQ_COUNT;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (v4l2_ioctl(fd, VIDIOC_REQBUFS, &req) < 0)
+    {
+        throw std::runtime_error("Could not request buffers: " + std::string(strerror(errno)));
+    }
+
+    try
+    {
+        for (uint32_t i = 0; i < req.count; i++)
+        {
+            struct v4l2_buffer buf = {};
+            buf.index = i;
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+
+            if (v4l2_ioctl(fd, VIDIOC_QUERYBUF, &buf) < 0)
+            {
+                throw std::runtime_error("Could not query buffer: " + std::string(strerror(errno)));
+            }
+
+            void *start = v4l2_mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+            if (start == MAP_FAILED)
+            {
+                throw std::runtime_error("MMap failed: " + std::string(strerror(errno)));
+            }
+            buffers.push_back({start, buf.length});
+
+            queue(i);
+        }
+
+        // Luma and RGB24 frames are handed out as they are. Everything else is
+        // converted into a RGB24 image for feeding into the neural net.
+        if (pixelLayoutFromFourcc(fmt.fmt.pix.pixelformat) == PixelLayout::Encoded)
+        {
+            convert_ctx = v4lconvert_create(fd);
+            if (!convert_ctx)
+            {
+                throw std::runtime_error("Failed to create v4lconvert context");
+            }
+        }
+
+        auto buf_type = static_cast<int>(V4L2_BUF_TYPE_VIDEO_CAPTURE);
+        if (v4l2_ioctl(fd, VIDIOC_STREAMON, &buf_type) < 0)
+        {
+            throw std::runtime_error("Could not start streaming: " + std::string(strerror(errno)));
+        }
+        streaming = true;
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+
+    // We cannot use the requested format here because it's a suggestion only.
+    native_format = ImageFormat::fromFourcc(fmt.fmt.pix.pixelformat, fmt.fmt.pix.width, fmt.fmt.pix.height);
+    native_format.buffersize = fmt.fmt.pix.sizeimage;
+
+    uint32_t output_fourcc = native_format.layout == PixelLayout::Encoded ? V4L2_PIX_FMT_RGB24 : native_format.fourcc;
+    format = ImageFormat::fromFourcc(output_fourcc, fmt.fmt.pix.width, fmt.fmt.pix.height);
+}
+
+CaptureSession::~CaptureSession()
+{
+    release();
+}
+
+/**
+ * Stop the stream and give every buffer back to the driver. This must never
+ * throw, since it runs from the destructor and from constructor unwinding.
+ */
+void CaptureSession::release() noexcept
+{
+    auto buf_type = static_cast<int>(V4L2_BUF_TYPE_VIDEO_CAPTURE);
+    if (streaming && v4l2_ioctl(fd, VIDIOC_STREAMOFF, &buf_type) < 0)
+    {
+        spdlog::warn("Could not stop streaming: {}", strerror(errno));
+    }
+    streaming = false;
+
+    if (convert_ctx)
+    {
+        v4lconvert_destroy(convert_ctx);
+        convert_ctx = nullptr;
+    }
+
+    for (const auto &buffer : buffers)
+    {
+        v4l2_munmap(buffer.start, buffer.length);
+    }
+    buffers.clear();
+
+    struct v4l2_requestbuffers req_free = {};
+    req_free.count = 0;
+    req_free.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req_free.memory = V4L2_MEMORY_MMAP;
+    if (v4l2_ioctl(fd, VIDIOC_REQBUFS, &req_free) < 0)
+    {
+        spdlog::warn("Could not free buffers: {}", strerror(errno));
+    }
+}
+
+void CaptureSession::queue(uint32_t index)
+{
+    struct v4l2_buffer buf = {};
+    buf.index = index;
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    if (v4l2_ioctl(fd, VIDIOC_QBUF, &buf) < 0)
+    {
+        throw std::runtime_error("Could not queue buffer: " + std::string(strerror(errno)));
+    }
+}
+
+/**
+ * Queue a buffer that was lent out as a `Frame`. Frames are released from
+ * destructors, so a failure is logged instead of thrown.
+ */
+void CaptureSession::requeue(uint32_t index) noexcept
+{
+    try
+    {
+        queue(index);
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::warn("{}", e.what());
+    }
+}
+
+/**
+ * Wait until the driver has filled a buffer, or the deadline has passed. DQBUF
+ * itself blocks for as long as the camera takes, which may be forever.
+ *
+ * @returns Whether a buffer is ready.
+ */
+bool CaptureSession::wait(std::chrono::steady_clock::time_point deadline)
+{
+    if (deadline == std::chrono::steady_clock::time_point::max())
+        return true;
+
+    while (true)
+    {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        pollfd ready = {.fd = fd, .events = POLLIN, .revents = 0};
+        int result = poll(&ready, 1, static_cast<int>(std::max<int64_t>(0, remaining.count())));
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0)
+            throw std::runtime_error("Could not wait for a frame: " + std::string(strerror(errno)));
+        return result > 0;
+    }
+}
+
+v4l2_buffer CaptureSession::dequeue()
+{
+    struct v4l2_buffer buf = {};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    if (v4l2_ioctl(fd, VIDIOC_DQBUF, &buf) < 0)
+    {
+        throw std::runtime_error("Could not dequeue buffer: " + std::string(strerror(errno)));
+    }
+    return buf;
+}
+
+/**
+ * Get the format of the images handed out by `next()`.
+ */
+const ImageFormat &CaptureSession::getFormat() const
+{
+    return format;
+}
+
+/**
+ * Get the format negotiated with the driver, i.e. the format of the frames
+ * handed out by `nextFrame()`.
+ */
+const ImageFormat &CaptureSession::getNativeFormat() const
+{
+    return native_format;
+}
+
+/**
+ * Get how the session warmed up. Only meaningful once the first frame was handed out.
+ */
+const WarmupStats &CaptureSession::getWarmupStats() const
+{
+    return warmup_stats;
+}
+
+/**
+ * The exposure time the driver currently uses, or -1 if it does not report one.
+ */
+int64_t CaptureSession::exposure()
+{
+    if (!has_exposure)
+        return -1;
+
+    struct v4l2_control control = {};
+    control.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+    if (v4l2_ioctl(fd, VIDIOC_G_CTRL, &control) < 0)
+    {
+        has_exposure = false;
+        return -1;
+    }
+    return control.value;
+}
+
+/**
+ * When the driver filled a buffer. Drivers stamp buffers with CLOCK_MONOTONIC,
+ * which is what the steady clock is on Linux; other clocks fall back to now.
+ */
+static std::chrono::steady_clock::time_point capture_time(const v4l2_buffer &buf)
+{
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        return std::chrono::steady_clock::now();
+
+    auto since_boot = std::chrono::seconds(buf.timestamp.tv_sec) + std::chrono::microseconds(buf.timestamp.tv_usec);
+    return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(since_boot));
+}
+
+/**
+ * Borrow the next non-empty buffer from the running stream, if one is filled
+ * before the deadline.
+ */
+std::optional<Frame> CaptureSession::dequeueFilled(std::chrono::steady_clock::time_point deadline)
+{
+    for (int attempt = 0; attempt < BUF_REQ_COUNT; attempt++)
+    {
+        if (!wait(deadline))
+            return std::nullopt;
+        v4l2_buffer buf = dequeue();
+
+        // IR cameras hand out a bunch of empty buffers before they produce data.
+        if (buf.bytesused == 0)
+        {
+            queue(buf.index);
+            continue;
+        }
+
+        return Frame(this, buf.index, buffers[buf.index].start, buf.bytesused, fmt.fmt.pix.bytesperline, native_format,
+                     capture_time(buf));
+    }
+
+    throw std::runtime_error("No data in buffer even after " + std::to_string(BUF_REQ_COUNT) + " attempts");
+}
+
+/**
+ * Borrow the next frame with data from the running stream, without copying it.
+ *
+ * Until the camera has warmed up, frames are only handed out once the picture
+ * has settled (see `WarmupDetector`); later calls return the next frame with data.
+ * The buffer is re-queued once the returned frame is destroyed.
+ *
+ * @returns A frame pointing into the mapped driver buffer.
+ */
+Frame CaptureSession::nextFrame()
+{
+    return std::move(nextFrame(std::chrono::steady_clock::time_point::max()).value());
+}
+
+/**
+ * Like `nextFrame()`, but give up once the deadline has passed, warmed up or not.
+ *
+ * @returns The frame, or nothing if none was ready before the deadline.
+ */
+std::optional<Frame> CaptureSession::nextFrame(std::chrono::steady_clock::time_point deadline)
+{
+    TRACE_SCOPE("capture.next_frame");
+    if (warmed_up)
+        return dequeueFilled(deadline);
+
+    TRACE_SCOPE("capture.warmup");
+    auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        std::optional<Frame> filled = dequeueFilled(deadline);
+        if (!filled.has_value())
+            return std::nullopt;
+        Frame &frame = filled.value();
+        FrameStats stats = FrameStats::measure(frame.getData(), native_format, frame.getStride());
+        if (!warmup.accept(stats, exposure()))
+            continue;
+
+        warmed_up = true;
+        warmup_stats = WarmupStats{
+            .frames_skipped = warmup.skipped(),
+            .elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start),
+            .settled = warmup.isSettled()};
+        spdlog::info("Camera warmed up after {} frames in {}us{}", warmup_stats.frames_skipped,
+                      warmup_stats.elapsed.count(), warmup_stats.settled ? "" : " without settling");
+        return filled;
+    }
+}
+
+/**
+ * Grab the next frame from the running stream as an owned image.
+ *
+ * Luma (GREY, Y16) and RGB24 frames keep their native layout and are only copied
+ * out of the driver buffer; any other format is converted into RGB24. The driver
+ * buffer is re-queued right after, so the ring stays full for the next call.
+ *
+ * @returns A unique pointer to the image buffer containing the image data.
+ */
+std::unique_ptr<ImageBuffer> CaptureSession::next()
+{
+    return nextBefore(std::chrono::steady_clock::time_point::max());
+}
+
+/**
+ * Like `next()`, but give up once the deadline has passed.
+ *
+ * @returns The image, or `nullptr` if no frame was ready before the deadline.
+ */
+std::unique_ptr<ImageBuffer> CaptureSession::nextBefore(std::chrono::steady_clock::time_point deadline)
+{
+    TRACE_SCOPE("capture.next");
+    std::optional<Frame> filled = nextFrame(deadline);
+    if (!filled.has_value())
+        return nullptr;
+    Frame &frame = filled.value();
+    TRACE_SCOPE("capture.convert");
+
+    if (!convert_ctx)
+    {
+        auto image = frame.view().materialize();
+        image->setCaptureTime(frame.getCaptureTime());
+        return image;
+    }
+
+    auto output = FramePool::getInstance().acquire(format.buffersize);
+
+    struct v4l2_format rgbfmt = {};
+    rgbfmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    rgbfmt.fmt.pix.width = format.width;
+    rgbfmt.fmt.pix.height = format.height;
+    rgbfmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+    rgbfmt.fmt.pix.bytesperline = format.width * 3;
+    rgbfmt.fmt.pix.sizeimage = format.buffersize;
+
+    if (v4lconvert_convert(
+            convert_ctx, &fmt, &rgbfmt,
+            static_cast<unsigned char *>(const_cast<void *>(frame.getData())), frame.getSize(),
+            reinterpret_cast<unsigned char *>(output.get()), rgbfmt.fmt.pix.sizeimage) < 0)
+    {
+        throw std::runtime_error("Could not convert buffer: " + std::string(v4lconvert_get_error_message(convert_ctx)));
+    }
+
+    auto image = std::make_unique<ImageBuffer>(std::move(output), format.buffersize, format);
+    image->setCaptureTime(frame.getCaptureTime());
+    return image;
+}
+
+/**
+ * Hand every buffer the driver filled in the meantime straight back to it, so the
+ * next frame is one captured from now on. The driver keeps filling the ring while
+ * nobody reads from it, so without this a request would start on old frames.
+ */
+void CaptureSession::flush()
+{
+    TRACE_SCOPE("capture.flush");
+    pollfd ready = {.fd = fd, .events = POLLIN, .revents = 0};
+    for (size_t drained = 0; drained < buffers.size(); drained++)
+    {
+        if (poll(&ready, 1, 0) <= 0 || !(ready.revents & POLLIN))
+            break;
+        queue(dequeue().index);
+    }
+}
@@ -0,0 +1,79 @@
+#include "frame.hpp"
+#include "capturesession.hpp"
+#include <utility>
+
+Frame::Frame(CaptureSession *session, uint32_t index, const void *data, size_t size, size_t stride, const ImageFormat &format,
+             std::chrono::steady_clock::time_point captured)
+    : session(session), index(index), data(data), size(size), stride(stride), format(format), captured(captured)
+{
+}
+
+Frame::Frame(Frame &&other) noexcept
+    : session(std::exchange(other.session, nullptr)), index(other.index), data(other.data),
+      size(other.size), stride(other.stride), format(other.format), captured(other.captured)
+{
+}
+
+Frame &Frame::operator=(Frame &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (session)
+            session->requeue(index);
+
+        session = std::exchange(other.session, nullptr);
+        index = other.index;
+        data = other.data;
+        size = other.size;
+        stride = other.stride;
+        format = other.format;
+        captured = other.captured;
+    }
+    return *this;
+}
+
+/**
+ * Hand the buffer back to the driver so it can be filled again.
+ */
+Frame::~Frame()
+{
+    if (session)
+        session->requeue(index);
+}
+
+const ImageFormat &Frame::getFormat() const { return format; }
+const void *Frame::getData() const { return data; }
+size_t Frame::getSize() const { return size; }
+size_t Frame::getStride() const { return stride; }
+
+/**
+ * When the driver filled the buffer, on the steady clock.
+ */
+std::chrono::steady_clock::time_point Frame::getCaptureTime() const { return captured; }
+
+/**
+ * A view of the frame, e.g. to crop it without copying. Only valid for as long
+ * as the frame is alive.
+ */
+ImageView Frame::view() const
+{
+    if (format.layout == PixelLayout::Encoded)
+        throw std::runtime_error("Frame pixel format cannot be viewed without conversion");
+
+    return ImageView(data, format, stride);
+}
+
+/**
+ * Wrap the frame in a `cv::Mat` header without copying the pixels. The returned
+ * matrix is only valid for as long as the frame is alive.
+ *
+ * Only uncompressed formats can be viewed this way; compressed or chroma
+ * subsampled formats have to go through `CaptureSession::next()` instead.
+ */
+cv::Mat Frame::as_mat() const
+{
+    if (format.layout == PixelLayout::Encoded)
+        throw std::runtime_error("Frame pixel format cannot be viewed without conversion");
+
+    return cv::Mat(format.height, format.width, format.cvType(), const_cast<void *>(data), stride);
+}
@@ -0,0 +1,88 @@
+#include "framepool.hpp"
+#include <algorithm>
+
+/**
+ * Make a pool that keeps at most `buffers_per_size` idle buffers of every size, for
+ * the `max_sizes` sizes used last. Buffers returned beyond that are freed.
+ */
+FramePool::FramePool(size_t buffers_per_size, size_t max_sizes)
+    : shelves(std::make_shared<Shelves>())
+{
+    shelves->capacity = buffers_per_size;
+    shelves->max_sizes = std::max<size_t>(max_sizes, 1);
+}
+
+/**
+ * Take a buffer of exactly `size` bytes from the pool, allocating a new one only
+ * if the shelf for that size is empty. The contents of the buffer are undefined.
+ */
+FramePool::Buffer FramePool::acquire(size_t size)
+{
+    {
+        std::lock_guard guard(shelves->lock);
+        auto [found, added] = shelves->free.try_emplace(size);
+        Shelf &shelf = found->second;
+        shelf.used = ++shelves->acquisitions;
+        if (!shelf.buffers.empty())
+        {
+            char *buffer = shelf.buffers.back().release();
+            shelf.buffers.pop_back();
+            shelves->stats.reuses++;
+            return Buffer(buffer, Recycler{shelves, size});
+        }
+
+        if (added && shelves->free.size() > shelves->max_sizes)
+        {
+            // Buffers of the evicted size that are still out are freed when they come back.
+            auto oldest = std::min_element(shelves->free.begin(), shelves->free.end(),
+                                           [](const auto &a, const auto &b)
+                                           { return a.second.used < b.second.used; });
+            shelves->free.erase(oldest);
+        }
+
+        // Returning a buffer must not allocate, so the shelf is sized up front.
+        shelf.buffers.reserve(shelves->capacity);
+        shelves->stats.allocations++;
+    }
+
+    return Buffer(new char[size], Recycler{shelves, size});
+}
+
+FramePoolStats FramePool::getStats() const
+{
+    std::lock_guard guard(shelves->lock);
+    FramePoolStats stats = shelves->stats;
+    stats.idle = 0;
+    for (const auto &[size, shelf] : shelves->free)
+        stats.idle += shelf.buffers.size();
+    stats.shelves = shelves->free.size();
+    return stats;
+}
+
+/**
+ * Free every idle buffer, e.g. after a stream changed resolution for good.
+ */
+void FramePool::clear()
+{
+    std::lock_guard guard(shelves->lock);
+    shelves->free.clear();
+}
+
+void FramePool::Recycler::operator()(char *buffer) const noexcept
+{
+    if (buffer == nullptr)
+        return;
+
+    if (auto owner = pool.lock())
+    {
+        std::lock_guard guard(owner->lock);
+        auto shelf = owner->free.find(size);
+        if (shelf != owner->free.end() && shelf->second.buffers.size() < owner->capacity)
+        {
+            shelf->second.buffers.emplace_back(buffer);
+            return;
+        }
+    }
+
+    delete[] buffer;
+}
@@ -0,0 +1,279 @@
+#include "framequality.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUALITY_X86 1
+#endif
+
+// Pixels at or above this luma count as saturated.
+#define SATURATED_LUMA 250
+
+// Running sums over the measured rows.
+struct LumaSums
+{
+    uint64_t sum = 0;
+    uint64_t squares = 0;
+    uint64_t gradient = 0;
+    uint64_t saturated = 0;
+};
+
+/**
+ * Add a row of `count` luma values to the sums. `luma(x)` reads the luma of pixel x.
+ */
+template <typename Luma>
+static void measure_row_scalar(Luma luma, size_t count, LumaSums &sums)
+{
+    unsigned int previous = luma(0);
+    for (size_t x = 0; x < count; x++)
+    {
+        unsigned int value = luma(x);
+        sums.sum += value;
+        sums.squares += value * value;
+        sums.saturated += value >= SATURATED_LUMA;
+        sums.gradient += value > previous ? value - previous : previous - value;
+        previous = value;
+    }
+}
+
+#ifdef QUALITY_X86
+__attribute__((target("avx2"))) static uint64_t sum_lanes(__m256i lanes)
+{
+    alignas(32) uint64_t values[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(values), lanes);
+    return values[0] + values[1] + values[2] + values[3];
+}
+
+/**
+ * Add a row of 8-bit luma to the sums, 32 pixels at a time. Sums and gradients come
+ * from `sad`, which adds up eight absolute differences per 64-bit lane.
+ */
+__attribute__((target("avx2"))) static void measure_row_avx2(const uint8_t *row, size_t count, LumaSums &sums)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i saturated_luma = _mm256_set1_epi8(static_cast<char>(SATURATED_LUMA));
+    __m256i sum = zero;
+    __m256i squares = zero;
+    __m256i gradient = zero;
+    uint64_t saturated = 0;
+
+    // The gradient needs the next pixel too, so stop one pixel short of a full load.
+    size_t x = 0;
+    for (; x + 33 <= count; x += 32)
+    {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x + 1));
+
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(pixels, zero));
+        gradient = _mm256_add_epi64(gradient, _mm256_sad_epu8(pixels, next));
+
+        __m256i bright = _mm256_cmpeq_epi8(_mm256_max_epu8(pixels, saturated_luma), pixels);
+        saturated += __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(bright)));
+
+        __m256i low = _mm256_unpacklo_epi8(pixels, zero);
+        __m256i high = _mm256_unpackhi_epi8(pixels, zero);
+        __m256i square_pairs = _mm256_add_epi32(_mm256_madd_epi16(low, low), _mm256_madd_epi16(high, high));
+        squares = _mm256_add_epi64(squares, _mm256_add_epi64(_mm256_unpacklo_epi32(square_pairs, zero),
+                                                             _mm256_unpackhi_epi32(square_pairs, zero)));
+    }
+
+    sums.sum += sum_lanes(sum);
+    sums.squares += sum_lanes(squares);
+    sums.gradient += sum_lanes(gradient);
+    sums.saturated += saturated;
+
+    if (x < count)
+    {
+        // The vectors already counted the step into the first pixel of the tail.
+        uint8_t previous = row[x];
+        for (; x < count; x++)
+        {
+            uint8_t value = row[x];
+            sums.sum += value;
+            sums.squares += value * value;
+            sums.saturated += value >= SATURATED_LUMA;
+            sums.gradient += value > previous ? value - previous : previous - value;
+            previous = value;
+        }
+    }
+}
+#endif
+
+QualityKernel bestQualityKernel()
+{
+#ifdef QUALITY_X86
+    if (__builtin_cpu_supports("avx2"))
+        return QualityKernel::AVX2;
+#endif
+    return QualityKernel::Scalar;
+}
+
+/**
+ * Measure the luma of a frame. Grey frames go through the SIMD kernel when the CPU
+ * has one; the other layouts use the same luma as `FrameStats`, in scalar code.
+ */
+FrameQuality FrameQuality::measure(const ImageView &view, QualityKernel kernel)
+{
+    FrameQuality quality;
+    const ImageFormat &format = view.getFormat();
+    if (format.width == 0 || format.height == 0)
+        return quality;
+
+    LumaSums sums;
+    uint64_t rows = 0;
+    for (unsigned int y = 0; y < format.height; y += ROW_STEP, rows++)
+    {
+        auto row = static_cast<const uint8_t *>(view.row(y));
+        switch (format.layout)
+        {
+        case PixelLayout::Grey:
+#ifdef QUALITY_X86
+            if (kernel == QualityKernel::AVX2)
+            {
+                measure_row_avx2(row, format.width, sums);
+                break;
+            }
+#endif
+            measure_row_scalar([row](size_t x)
+                               { return static_cast<unsigned int>(row[x]); },
+                               format.width, sums);
+            break;
+        case PixelLayout::Y16:
+            measure_row_scalar([row](size_t x)
+                               { return static_cast<unsigned int>(row[x * 2 + 1]); },
+                               format.width, sums);
+            break;
+        case PixelLayout::RGB24:
+            measure_row_scalar([row](size_t x)
+                               {
+                                   const uint8_t *pixel = row + x * 3;
+                                   return static_cast<unsigned int>((pixel[0] + 2 * pixel[1] + pixel[2]) / 4); },
+                               format.width, sums);
+            break;
+        default:
+            break;
+        }
+    }
+
+    double samples = static_cast<double>(rows) * format.width;
+    quality.valid = true;
+    quality.mean = sums.sum / samples;
+    quality.stddev = std::sqrt(std::max(0.0, sums.squares / samples - quality.mean * quality.mean));
+    quality.saturated = sums.saturated / samples;
+    quality.sharpness = format.width > 1 ? sums.gradient / (static_cast<double>(rows) * (format.width - 1)) : 0;
+    return quality;
+}
+
+/**
+ * Measure the luma of an image, if it has pixels to measure and was not measured
+ * before. Encoded images cannot be viewed, so they come back invalid.
+ */
+FrameQuality FrameQuality::measure(const ImageBuffer &image, QualityKernel kernel)
+{
+    if (const FrameQuality *measured = image.getQuality())
+        return *measured;
+    if (image.getFormat().layout == PixelLayout::Encoded)
+        return FrameQuality();
+    return measure(image.view(), kernel);
+}
+
+const char *verdictName(FrameVerdict verdict)
+{
+    switch (verdict)
+    {
+    case FrameVerdict::Usable:
+        return "usable";
+    case FrameVerdict::Dark:
+        return "dark";
+    case FrameVerdict::Saturated:
+        return "saturated";
+    case FrameVerdict::Flat:
+        return "flat";
+    case FrameVerdict::Blurry:
+        return "blurry";
+    case FrameVerdict::EmitterOff:
+        return "emitter_off";
+    }
+    return "unknown";
+}
+
+EmitterPhase::EmitterPhase(double off_ratio, double min_lit, size_t window)
+    : off_ratio(off_ratio), min_lit(min_lit), window(std::max<size_t>(window, 1))
+{
+}
+
+EmitterPhase::EmitterPhase(const QualityConfig &config)
+    : EmitterPhase(config.emitter_off_ratio, 2 * config.dark_mean, config.emitter_window)
+{
+}
+
+bool EmitterPhase::isOff(double mean)
+{
+    double brightest = recent.empty() ? 0 : *std::max_element(recent.begin(), recent.end());
+    bool off = off_ratio > 0 && brightest >= min_lit && mean < brightest * off_ratio;
+
+    recent.push_back(mean);
+    while (recent.size() > window)
+        recent.pop_front();
+    return off;
+}
+
+FrameQualityGate::FrameQualityGate(const QualityConfig &config)
+    : config(config), emitter(config)
+{
+}
+
+/**
+ * Judge the next frame of the stream.
+ *
+ * A frame taken with the emitter off is rejected even if it would pass on its own:
+ * lit by ambient light only, a face in it does not look like the enrolled IR face.
+ */
+FrameVerdict FrameQualityGate::judge(const FrameQuality &quality)
+{
+    FrameVerdict verdict = FrameVerdict::Usable;
+    if (quality.valid)
+    {
+        if (emitter.isOff(quality.mean))
+            verdict = FrameVerdict::EmitterOff;
+        else if (quality.mean < config.dark_mean)
+            verdict = FrameVerdict::Dark;
+        else if (quality.saturated > config.max_saturated)
+            verdict = FrameVerdict::Saturated;
+        else if (quality.stddev < config.min_stddev)
+            verdict = FrameVerdict::Flat;
+        else if (quality.sharpness < config.min_sharpness)
+            verdict = FrameVerdict::Blurry;
+    }
+
+    counts[static_cast<size_t>(verdict)]++;
+    return verdict;
+}
+
+FrameVerdict FrameQualityGate::judge(const ImageView &view)
+{
+    return judge(FrameQuality::measure(view));
+}
+
+FrameVerdict FrameQualityGate::judge(const ImageBuffer &image)
+{
+    return judge(FrameQuality::measure(image));
+}
+
+const VerdictCounts &FrameQualityGate::getCounts() const
+{
+    return counts;
+}
+
+int FrameQualityGate::rejected() const
+{
+    int total = 0;
+    for (size_t verdict = 0; verdict < counts.size(); verdict++)
+    {
+        if (verdict != static_cast<size_t>(FrameVerdict::Usable))
+            total += counts[verdict];
+    }
+    return total;
+}
@@ -0,0 +1,16 @@
+#include "framesource.hpp"
+#include "trace.hpp"
+
+/**
+ * Grab a single image for the given image format.
+ *
+ * This sets up and tears down a whole stream for a single frame. Callers that need
+ * more than one frame should hold on to the stream from `open()`.
+ *
+ * @returns A unique pointer to the image buffer containing the image data.
+ */
+std::unique_ptr<ImageBuffer> FrameSource::grab(const ImageFormat &format) const
+{
+    TRACE_SCOPE("capture.grab");
+    return this->open(format)->next();
+}
@@ -1,41 +1,143 @@
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#define STB_IMAGE_RESIZE2_IMPLEMENTATION
-
 #include "image.hpp"
+#include "resize.hpp"
 #include <cassert>
+#include <cstring>
+#include <utility>
 
-#include "stb_image_resize2.h"
+/**
+ * Map a V4L2 fourcc to the layout of its pixels in memory.
+ */
+PixelLayout pixelLayoutFromFourcc(uint32_t fourcc)
+{
+    switch (fourcc)
+    {
+    case V4L2_PIX_FMT_GREY:
+        return PixelLayout::Grey;
+    case V4L2_PIX_FMT_Y16:
+        return PixelLayout::Y16;
+    case V4L2_PIX_FMT_RGB24:
+        return PixelLayout::RGB24;
+    default:
+        return PixelLayout::Encoded;
+    }
+}
 
-ImageBuffer::ImageBuffer(const void *databuffer, uint32_t size, const ImageFormat format)
-    : format(format), bufferSize(size), buffer(std::make_unique<char[]>(size))
+/**
+ * Parse a fourcc like `GREY` or `MJPG`, as given on the command line or in a config.
+ */
+uint32_t fourccFromString(const std::string &fourcc)
 {
-    std::memcpy(buffer.get(), databuffer, size);
+    if (fourcc.size() != 4)
+        throw std::runtime_error("A fourcc must be exactly four characters: " + fourcc);
+
+    return v4l2_fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]);
 }
 
-ImageBuffer::ImageBuffer(const ImageBuffer &other)
-    : format(other.format), bufferSize(other.bufferSize), buffer(std::make_unique<char[]>(other.bufferSize))
+/**
+ * Build a tightly packed image format for the given fourcc and dimensions.
+ */
+ImageFormat ImageFormat::fromFourcc(uint32_t fourcc, unsigned int width, unsigned int height)
 {
-    std::memcpy(buffer.get(), other.buffer.get(), bufferSize);
+    ImageFormat format = {.fourcc = fourcc, .width = width, .height = height, .buffersize = 0};
+    format.layout = pixelLayoutFromFourcc(fourcc);
+    switch (format.layout)
+    {
+    case PixelLayout::Encoded:
+        format.channels = 0;
+        break;
+    case PixelLayout::RGB24:
+        format.channels = 3;
+        break;
+    default:
+        format.channels = 1;
+        break;
+    }
+    format.buffersize = static_cast<size_t>(width) * height * format.bytesPerPixel();
+    return format;
 }
 
-ImageBuffer &ImageBuffer::operator=(const ImageBuffer &other)
+/**
+ * Number of bytes a single pixel occupies, or 0 for encoded formats.
+ */
+size_t ImageFormat::bytesPerPixel() const
 {
-    if (this != &other)
+    switch (layout)
     {
-        format = other.format;
-        bufferSize = other.bufferSize;
-        buffer = std::make_unique<char[]>(other.bufferSize);
-        std::memcpy(buffer.get(), other.buffer.get(), bufferSize);
+    case PixelLayout::Grey:
+        return 1;
+    case PixelLayout::Y16:
+        return 2;
+    case PixelLayout::RGB24:
+        return 3;
+    default:
+        return 0;
     }
-    return *this;
+}
+
+/**
+ * The OpenCV matrix type matching the pixel layout.
+ */
+int ImageFormat::cvType() const
+{
+    switch (layout)
+    {
+    case PixelLayout::Grey:
+        return CV_8UC1;
+    case PixelLayout::Y16:
+        return CV_16UC1;
+    case PixelLayout::RGB24:
+        return CV_8UC3;
+    default:
+        throw std::runtime_error("Encoded images have no matrix representation");
+    }
+}
+
+/**
+ * Copy the pixels into a buffer from the frame pool.
+ */
+ImageBuffer::ImageBuffer(const void *databuffer, uint32_t size, const ImageFormat format)
+    : format(format), buffer(FramePool::getInstance().acquire(size)), bufferSize(size)
+{
+    std::memcpy(buffer.get(), databuffer, size);
+}
+
+/**
+ * Take ownership of an already filled buffer, without copying it. The buffer is
+ * freed, not pooled, when the image is destroyed.
+ */
+ImageBuffer::ImageBuffer(std::unique_ptr<char[]> databuffer, uint32_t size, const ImageFormat format)
+    : format(format), buffer(databuffer.release(), FramePool::Recycler{}), bufferSize(size)
+{
+}
+
+/**
+ * Take ownership of an already filled buffer from the frame pool, without copying it.
+ */
+ImageBuffer::ImageBuffer(PooledBuffer databuffer, uint32_t size, const ImageFormat format)
+    : format(format), buffer(std::move(databuffer)), bufferSize(size)
+{
 }
 
 ImageBuffer::ImageBuffer(ImageBuffer &&other) noexcept
-    : format(other.format), bufferSize(other.bufferSize), buffer(std::move(other.buffer))
+    : format(other.format), buffer(std::move(other.buffer)), bufferSize(other.bufferSize), captured(other.captured),
+      quality(std::move(other.quality))
 {
     other.bufferSize = 0;
 }
 
+ImageBuffer &ImageBuffer::operator=(ImageBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        format = other.format;
+        buffer = std::move(other.buffer);
+        bufferSize = std::exchange(other.bufferSize, 0);
+        captured = other.captured;
+        quality = std::move(other.quality);
+    }
+    return *this;
+}
+
 const ImageFormat &ImageBuffer::getFormat() const { return format; }
 
 cv::Mat ImageBuffer::to_mat()
@@ -45,63 +147,153 @@ cv::Mat ImageBuffer::to_mat()
 
     int h = this->format.height;
     int w = this->format.width;
-    cv::Mat rval(h, w, CV_8UC3);
-    std::memcpy(rval.data, data, h * w * 3);
+    cv::Mat rval(h, w, this->format.cvType());
+    std::memcpy(rval.data, data, h * w * this->format.bytesPerPixel());
     return rval;
 }
 
 const void *ImageBuffer::getData() const { return this->buffer.get(); }
 size_t ImageBuffer::getSize() const { return this->bufferSize; }
+std::chrono::steady_clock::time_point ImageBuffer::getCaptureTime() const { return this->captured; }
+void ImageBuffer::setCaptureTime(std::chrono::steady_clock::time_point time) { this->captured = time; }
+const FrameQuality *ImageBuffer::getQuality() const { return this->quality.get(); }
+void ImageBuffer::setQuality(std::shared_ptr<const FrameQuality> quality) { this->quality = std::move(quality); }
 
+/**
+ * Resize the image, keeping its pixel layout. Luma images stay single channel
+ * and no gamma curve is applied; see `resize_into()` for the filters.
+ */
 std::unique_ptr<ImageBuffer> ImageBuffer::resizeTo(unsigned int newWidth, unsigned int newHeight) const
 {
-    int numChannels = 3;
-    int inputStride = format.width * numChannels;
-    int outputStride = newWidth * numChannels;
+    size_t bytesPerPixel = format.bytesPerPixel();
+    assert(bytesPerPixel > 0 && "Cannot resize an encoded image");
 
-    void *resizedBuffer = new char[newWidth * newHeight * numChannels];
+    ImageFormat resizedFormat = format;
+    resizedFormat.width = newWidth;
+    resizedFormat.height = newHeight;
+    resizedFormat.buffersize = static_cast<size_t>(newWidth) * newHeight * bytesPerPixel;
 
-    stbir_resize_uint8_srgb(
-        reinterpret_cast<const unsigned char *>(buffer.get()), format.width, format.height, inputStride,
-        reinterpret_cast<unsigned char *>(resizedBuffer), newWidth, newHeight, outputStride,
-        STBIR_RGB);
+    auto resizedBuffer = FramePool::getInstance().acquire(resizedFormat.buffersize);
+    resize_into(view(), resizedBuffer.get(), newWidth, newHeight, newWidth * bytesPerPixel);
 
-    return std::make_unique<ImageBuffer>(resizedBuffer, newWidth * newHeight * numChannels,
-                                         ImageFormat{format.fourcc, newWidth, newHeight, newWidth * newHeight * numChannels});
+    return std::make_unique<ImageBuffer>(std::move(resizedBuffer), resizedFormat.buffersize, resizedFormat);
 }
 
+/**
+ * Crop the image to the given region, in fractions of the width and height, and
+ * copy the region into a new image. Use `cropView()` to avoid the copy.
+ */
 std::unique_ptr<ImageBuffer> ImageBuffer::cropImage(double x0, double y0, double x1, double y1) const
 {
+    return cropView(x0, y0, x1, y1).materialize();
+}
+
+/**
+ * A view of the whole image.
+ */
+ImageView ImageBuffer::view() const
+{
+    return ImageView(buffer.get(), format, static_cast<size_t>(format.width) * format.bytesPerPixel());
+}
+
+/**
+ * A view of the given region of the image, in fractions of the width and height.
+ * The view shares the pixels with this image.
+ */
+ImageView ImageBuffer::cropView(double x0, double y0, double x1, double y1) const
+{
+    return view().crop(x0, y0, x1, y1);
+}
+
+ImageView::ImageView(const void *data, const ImageFormat &format, size_t stride)
+    : data(static_cast<const char *>(data)), format(format), stride(stride)
+{
+    assert(format.bytesPerPixel() > 0 && "Cannot view an encoded image");
+}
+
+/**
+ * A view of the pixels of a matrix. Single channel 8 and 16-bit matrices become
+ * luma views, 3-channel 8-bit matrices RGB24 views (whatever their channel order).
+ */
+ImageView ImageView::fromMat(const cv::Mat &image)
+{
+    uint32_t fourcc;
+    switch (image.type())
+    {
+    case CV_8UC1:
+        fourcc = V4L2_PIX_FMT_GREY;
+        break;
+    case CV_16UC1:
+        fourcc = V4L2_PIX_FMT_Y16;
+        break;
+    case CV_8UC3:
+        fourcc = V4L2_PIX_FMT_RGB24;
+        break;
+    default:
+        throw std::runtime_error("Matrix type has no pixel layout");
+    }
+
+    return ImageView(image.data, ImageFormat::fromFourcc(fourcc, image.cols, image.rows), image.step[0]);
+}
+
+const ImageFormat &ImageView::getFormat() const { return format; }
+const void *ImageView::getData() const { return data; }
+size_t ImageView::getStride() const { return stride; }
+const void *ImageView::row(unsigned int y) const { return data + y * stride; }
+
+/**
+ * Narrow the view down to a region, in fractions of its width and height.
+ * Only the offset and dimensions change; the stride stays that of the parent.
+ *
+ * @throws std::runtime_error if the region is empty or reaches outside the view.
+ */
+ImageView ImageView::crop(double x0, double y0, double x1, double y1) const
+{
+    // Checked before the conversion, which would wrap negative fractions around.
+    if (!(0 <= x0 && x0 < x1 && x1 <= 1 && 0 <= y0 && y0 < y1 && y1 <= 1))
+        throw std::runtime_error("Invalid crop dimensions");
+
     unsigned int start_x = static_cast<unsigned int>(x0 * format.width);
     unsigned int start_y = static_cast<unsigned int>(y0 * format.height);
     unsigned int end_x = static_cast<unsigned int>(x1 * format.width);
     unsigned int end_y = static_cast<unsigned int>(y1 * format.height);
 
-    unsigned int new_width = end_x - start_x;
-    unsigned int new_height = end_y - start_y;
+    if (end_x <= start_x || end_y <= start_y)
+        throw std::runtime_error("Crop is smaller than a pixel");
 
-    assert(new_width > 0 && new_height > 0 && "Invalid crop dimensions");
+    ImageFormat croppedFormat = format;
+    croppedFormat.width = end_x - start_x;
+    croppedFormat.height = end_y - start_y;
+    croppedFormat.buffersize = static_cast<size_t>(croppedFormat.width) * croppedFormat.height * format.bytesPerPixel();
 
-    size_t new_size = new_width * new_height * 3; // Assuming 3 channels (RGB)
-    void *croppedBuffer = new char[new_size];
+    return ImageView(data + start_y * stride + start_x * format.bytesPerPixel(), croppedFormat, stride);
+}
 
-    for (unsigned int y = 0; y < new_height; ++y)
-    {
-        unsigned int src_y = start_y + y;
-        unsigned int dst_y = y;
+/**
+ * Copy the pixels of the view into a new, tightly packed image, one row at a time.
+ */
+std::unique_ptr<ImageBuffer> ImageView::materialize() const
+{
+    size_t row_size = static_cast<size_t>(format.width) * format.bytesPerPixel();
+    auto pixels = FramePool::getInstance().acquire(format.buffersize);
 
-        for (unsigned int x = 0; x < new_width; ++x)
-        {
-            unsigned int src_x = start_x + x;
-            unsigned int dst_x = x;
+    if (stride == row_size)
+    {
+        std::memcpy(pixels.get(), data, format.buffersize);
+    }
+    else
+    {
+        for (unsigned int y = 0; y < format.height; ++y)
+            std::memcpy(pixels.get() + y * row_size, row(y), row_size);
+    }
 
-            size_t src_index = (src_y * format.width + src_x) * 3;
-            size_t dst_index = (dst_y * new_width + dst_x) * 3;
+    return std::make_unique<ImageBuffer>(std::move(pixels), format.buffersize, format);
+}
 
-            std::memcpy(static_cast<char *>(croppedBuffer) + dst_index,
-                        static_cast<char *>(buffer.get()) + src_index, 3);
-        }
-    }
-    return std::make_unique<ImageBuffer>(croppedBuffer, new_size,
-                                         ImageFormat{format.fourcc, new_width, new_height, new_size});
-}
\ No newline at end of file
+/**
+ * Wrap the view in a `cv::Mat` header without copying the pixels.
+ */
+cv::Mat ImageView::as_mat() const
+{
+    return cv::Mat(format.height, format.width, format.cvType(), const_cast<char *>(data), stride);
+}
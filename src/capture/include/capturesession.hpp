@@ -0,0 +1,80 @@
+#ifndef CAPTURE_SESSION_HPP
+#define CAPTURE_SESSION_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <linux/videodev2.h>
+
+#include "libv4l2.h"
+#include "libv4lconvert.h"
+
+#include "image.hpp"
+#include "frame.hpp"
+#include "framesource.hpp"
+#include "warmup.hpp"
+
+/**
+ * @brief A long-lived streaming session on an open video device.
+ *
+ * The session negotiates the format, requests and maps the driver buffers and
+ * starts streaming exactly once. Every call to `next()` then costs a single
+ * DQBUF/QBUF pair instead of a full setup and teardown of the stream. The
+ * stream is stopped and all buffers are released when the session is destroyed.
+ *
+ * Frames can either be borrowed straight from the mapped buffers with `nextFrame()`,
+ * or copied into an owned `ImageBuffer` with `next()`. Luma and RGB24 streams keep
+ * their native layout; encoded streams are converted into RGB24.
+ *
+ * Only one session can be active on a device at any given time.
+ */
+class CaptureSession : public FrameStream
+{
+private:
+    struct MappedBuffer
+    {
+        void *start;
+        size_t length;
+    };
+
+    int fd;
+    bool streaming = false;
+    bool warmed_up = false;
+    bool has_exposure = true;
+    WarmupDetector warmup;
+    WarmupStats warmup_stats;
+    v4l2_format fmt = {};
+    ImageFormat native_format;
+    ImageFormat format;
+    std::vector<MappedBuffer> buffers;
+    v4lconvert_data *convert_ctx = nullptr;
+
+    void release() noexcept;
+    void queue(uint32_t index);
+    void requeue(uint32_t index) noexcept;
+    bool wait(std::chrono::steady_clock::time_point deadline);
+    v4l2_buffer dequeue();
+    std::optional<Frame> dequeueFilled(std::chrono::steady_clock::time_point deadline);
+    int64_t exposure();
+
+    friend class Frame;
+
+public:
+    CaptureSession(int fd, const ImageFormat &format, bool is_ir);
+    CaptureSession(const CaptureSession &) = delete;
+    CaptureSession &operator=(const CaptureSession &) = delete;
+    ~CaptureSession() override;
+
+    const ImageFormat &getFormat() const override;
+    const ImageFormat &getNativeFormat() const;
+    const WarmupStats &getWarmupStats() const;
+    Frame nextFrame();
+    std::optional<Frame> nextFrame(std::chrono::steady_clock::time_point deadline);
+    std::unique_ptr<ImageBuffer> next() override;
+    std::unique_ptr<ImageBuffer> nextBefore(std::chrono::steady_clock::time_point deadline) override;
+    void flush() override;
+};
+
+#endif
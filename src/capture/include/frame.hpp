@@ -0,0 +1,52 @@
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#include <opencv2/opencv.hpp>
+
+#include "image.hpp"
+
+class CaptureSession;
+
+/**
+ * @brief A frame borrowed from the mmapped V4L2 buffer ring of a capture session.
+ *
+ * The frame points straight into driver memory, no bytes are copied. The buffer is
+ * handed back to the driver when the frame is destroyed, so frames should be
+ * short-lived: while a frame is held, its buffer cannot be filled with new data.
+ * The session that produced a frame must outlive it.
+ */
+class Frame
+{
+private:
+    CaptureSession *session;
+    uint32_t index;
+    const void *data;
+    size_t size;
+    size_t stride;
+    ImageFormat format;
+    std::chrono::steady_clock::time_point captured;
+
+public:
+    Frame(CaptureSession *session, uint32_t index, const void *data, size_t size, size_t stride, const ImageFormat &format,
+          std::chrono::steady_clock::time_point captured);
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+    Frame(Frame &&other) noexcept;
+    Frame &operator=(Frame &&other) noexcept;
+    ~Frame();
+
+    const ImageFormat &getFormat() const;
+    const void *getData() const;
+    size_t getSize() const;
+    size_t getStride() const;
+    std::chrono::steady_clock::time_point getCaptureTime() const;
+
+    ImageView view() const;
+    cv::Mat as_mat() const;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef FRAME_POOL_HPP
+#define FRAME_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Statistics of a frame pool. `allocations` only grows while the pool warms
+ * up; in steady state every acquired buffer should be a reuse.
+ */
+struct FramePoolStats
+{
+    size_t allocations = 0;
+    size_t reuses = 0;
+    size_t idle = 0;
+    size_t shelves = 0;
+};
+
+/**
+ * @brief A recycling pool of frame sized pixel buffers.
+ *
+ * Buffers are kept on one shelf per byte size, which in practice means one shelf per
+ * resolution and pixel layout a pipeline works with (the capture size, the crop, the
+ * network input). A buffer handed out by `acquire()` goes back onto its shelf when it
+ * is destroyed, so a stream that keeps producing frames of the same formats stops
+ * allocating after the first few frames. Only the most recently used sizes keep a
+ * shelf, so sizes a pipeline no longer works with (an old resolution, the crop of a
+ * face that has since moved) do not keep their buffers forever.
+ *
+ * The pool can be destroyed before the buffers it handed out; those are then freed
+ * normally. Most code should use the process-wide pool from `getInstance()`.
+ */
+class FramePool
+{
+private:
+    struct Shelf
+    {
+        std::vector<std::unique_ptr<char[]>> buffers;
+        // When a buffer of this size was last acquired, in acquisitions.
+        uint64_t used = 0;
+    };
+
+    struct Shelves
+    {
+        std::mutex lock;
+        std::unordered_map<size_t, Shelf> free;
+        size_t capacity;
+        size_t max_sizes;
+        uint64_t acquisitions = 0;
+        FramePoolStats stats;
+    };
+
+    std::shared_ptr<Shelves> shelves;
+
+public:
+    /**
+     * @brief Deleter that puts a buffer back onto the shelf of its pool. A default
+     * constructed recycler does not belong to a pool and just frees the buffer.
+     */
+    struct Recycler
+    {
+        std::weak_ptr<Shelves> pool;
+        size_t size = 0;
+
+        void operator()(char *buffer) const noexcept;
+    };
+
+    using Buffer = std::unique_ptr<char[], Recycler>;
+
+    explicit FramePool(size_t buffers_per_size = 8, size_t max_sizes = 16);
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    static FramePool &getInstance()
+    {
+        static FramePool instance;
+        return instance;
+    }
+
+    Buffer acquire(size_t size);
+    FramePoolStats getStats() const;
+    void clear();
+};
+
+using PooledBuffer = FramePool::Buffer;
+
+#endif
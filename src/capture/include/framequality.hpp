@@ -0,0 +1,145 @@
+#ifndef FRAME_QUALITY_HPP
+#define FRAME_QUALITY_HPP
+
+#include <array>
+#include <cstddef>
+#include <deque>
+
+#include "image.hpp"
+
+/**
+ * @brief The instruction set used to measure 8-bit luma frames. Other layouts
+ * always use the scalar kernel.
+ */
+enum class QualityKernel
+{
+    Scalar,
+    AVX2
+};
+
+QualityKernel bestQualityKernel();
+
+/**
+ * @brief Luma statistics that tell whether a frame can show a face at all, taken
+ * on every pixel of every `ROW_STEP`-th row. Values are scaled to 0..255 whatever
+ * the bit depth of the frame. `valid` is false for encoded frames, which have no
+ * pixels to measure until they are converted.
+ */
+struct FrameQuality
+{
+    static constexpr unsigned int ROW_STEP = 4;
+
+    bool valid = false;
+    double mean = 0;
+    double stddev = 0;
+    // Fraction of pixels at or above 250.
+    double saturated = 0;
+    // Mean absolute difference of horizontally neighbouring pixels. Out of focus,
+    // covered or motion blurred frames have next to no edges.
+    double sharpness = 0;
+
+    static FrameQuality measure(const ImageView &view, QualityKernel kernel = bestQualityKernel());
+    static FrameQuality measure(const ImageBuffer &image, QualityKernel kernel = bestQualityKernel());
+};
+
+/**
+ * @brief Why a frame was or was not handed on to detection.
+ */
+enum class FrameVerdict
+{
+    Usable,
+    Dark,
+    Saturated,
+    Flat,
+    Blurry,
+    EmitterOff,
+};
+
+const char *verdictName(FrameVerdict verdict);
+
+/**
+ * @brief Thresholds of the `FrameQualityGate`. They are loose on purpose: the gate
+ * only throws away frames no detector could find a face in.
+ */
+struct QualityConfig
+{
+    // Frames with a lower mean luma are dark.
+    double dark_mean = 10;
+    // Frames with more saturated pixels than this fraction are blown out.
+    double max_saturated = 0.5;
+    // Frames with less contrast than this are flat, e.g. a covered lens.
+    double min_stddev = 4;
+    // Frames with fewer edges than this are blurry.
+    double min_sharpness = 0.75;
+    // IR emitters often light only every other frame. A frame darker than this
+    // fraction of the brightest of the last `emitter_window` frames was taken with
+    // the emitter off. Zero turns the check off.
+    double emitter_off_ratio = 0.6;
+    size_t emitter_window = 4;
+};
+
+/**
+ * @brief Tells the frames taken with the IR emitter off from the lit ones.
+ *
+ * Many IR cameras only light the emitter for every other frame, which leaves a
+ * stream of alternating bright and dark frames. A frame much darker than the
+ * brightest of the last few was taken with the emitter off.
+ */
+class EmitterPhase
+{
+private:
+    double off_ratio;
+    double min_lit;
+    size_t window;
+    // Mean luma of the last frames, oldest first.
+    std::deque<double> recent;
+
+public:
+    /**
+     * @param off_ratio Frames darker than this fraction of the brightest recent one
+     * are off. Zero turns the check off.
+     * @param min_lit Recent frames must reach this mean luma to count as lit at all.
+     * @param window How many recent frames to compare to.
+     */
+    EmitterPhase(double off_ratio, double min_lit, size_t window);
+    explicit EmitterPhase(const QualityConfig &config);
+
+    /**
+     * Whether the next frame of the stream, with the given mean luma, was taken with
+     * the emitter off.
+     */
+    bool isOff(double mean);
+};
+
+/**
+ * @brief Counts of the verdicts of a gate, by `FrameVerdict`.
+ */
+using VerdictCounts = std::array<int, static_cast<size_t>(FrameVerdict::EmitterOff) + 1>;
+
+/**
+ * @brief A cheap check in front of the DNNs that rejects frames which cannot
+ * match: all dark, blown out, featureless, blurred, or taken between two
+ * pulses of the IR emitter.
+ *
+ * A gate belongs to a single stream, since it compares each frame to the ones
+ * before it. Frames that cannot be measured pass.
+ */
+class FrameQualityGate
+{
+private:
+    QualityConfig config;
+    EmitterPhase emitter;
+    VerdictCounts counts = {};
+
+public:
+    explicit FrameQualityGate(const QualityConfig &config = {});
+
+    FrameVerdict judge(const FrameQuality &quality);
+    FrameVerdict judge(const ImageView &view);
+    FrameVerdict judge(const ImageBuffer &image);
+
+    const VerdictCounts &getCounts() const;
+    int rejected() const;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "image.hpp"
+
+/**
+ * @brief An open stream of frames, e.g. a running camera session or a replay.
+ */
+class FrameStream
+{
+public:
+    virtual ~FrameStream() = default;
+
+    /**
+     * The format of the images handed out by `next()`.
+     */
+    virtual const ImageFormat &getFormat() const = 0;
+
+    /**
+     * Get the next frame. Throws once the stream cannot produce any more frames.
+     */
+    virtual std::unique_ptr<ImageBuffer> next() = 0;
+
+    /**
+     * Like `next()`, but give up once the deadline has passed. Streams that produce
+     * frames on demand never wait for long, and just return `next()`.
+     *
+     * @returns The frame, or `nullptr` if none came before the deadline.
+     */
+    virtual std::unique_ptr<ImageBuffer> nextBefore(std::chrono::steady_clock::time_point deadline)
+    {
+        (void)deadline;
+        return next();
+    }
+
+    /**
+     * Drop the frames that were captured but not handed out yet. Streams that
+     * produce frames on demand have nothing to drop.
+     */
+    virtual void flush() {}
+};
+
+/**
+ * @brief Anything frames can be streamed from: a V4L2 camera, or a recording
+ * replayed from disk for benchmarks and tests without a camera.
+ */
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+
+    virtual const std::string getPath() const = 0;
+
+    /**
+     * Start streaming in the given format. The format is a suggestion, the
+     * stream reports the format it actually delivers.
+     */
+    virtual std::unique_ptr<FrameStream> open(const ImageFormat &format) const = 0;
+
+    std::unique_ptr<ImageBuffer> grab(const ImageFormat &format) const;
+};
+
+#endif
@@ -1,20 +1,39 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <string>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
 
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-
 #include "libv4lconvert.h"
+#include "framepool.hpp"
+
+/**
+ * @brief How the pixels of an image are laid out in memory.
+ * `Encoded` covers everything (MJPG, YUYV, ...) that has to be converted before
+ * the pixels can be addressed directly.
+ */
+enum class PixelLayout
+{
+    Encoded,
+    Grey,
+    Y16,
+    RGB24
+};
+
+PixelLayout pixelLayoutFromFourcc(uint32_t fourcc);
+uint32_t fourccFromString(const std::string &fourcc);
 
 /**
  * @brief A supported image format in the camera device.
- * This struct only stores the pixel format fourcc and dimensions of the image.
+ * This struct only stores the pixel format fourcc and dimensions of the image,
+ * along with the channel count and pixel layout of directly addressable images.
+ * Formats listed by fourcc alone count as encoded until `fromFourcc()` says otherwise.
  */
 struct ImageFormat
 {
@@ -22,32 +41,87 @@ struct ImageFormat
     unsigned int width;
     unsigned int height;
     size_t buffersize;
+    unsigned int channels = 0;
+    PixelLayout layout = PixelLayout::Encoded;
+
+    static ImageFormat fromFourcc(uint32_t fourcc, unsigned int width, unsigned int height);
+    size_t bytesPerPixel() const;
+    int cvType() const;
 
     const ImageFormat &getFormat();
     const void *getData();
     size_t getSize() const;
 };
 
+class ImageBuffer;
+struct FrameQuality;
+
+/**
+ * @brief A non-owning, possibly strided window into the pixels of another image.
+ *
+ * Views are cheap to make and to pass around; no pixels are copied until
+ * `materialize()` is called. The image a view points into must outlive it.
+ */
+class ImageView
+{
+private:
+    const char *data;
+    ImageFormat format;
+    size_t stride;
+
+public:
+    ImageView(const void *data, const ImageFormat &format, size_t stride);
+    static ImageView fromMat(const cv::Mat &image);
+
+    const ImageFormat &getFormat() const;
+    const void *getData() const;
+    size_t getStride() const;
+    const void *row(unsigned int y) const;
+
+    ImageView crop(double x0, double y0, double x1, double y1) const;
+    std::unique_ptr<ImageBuffer> materialize() const;
+    cv::Mat as_mat() const;
+};
+
+/**
+ * @brief An owned image. The pixels live in a buffer from the `FramePool` and go
+ * back to the pool when the image is destroyed, so images are move-only.
+ *
+ * Images remember when they were captured, on the steady clock. That is the time
+ * they were made, unless the source knows better (e.g. the V4L2 buffer timestamp).
+ * They also keep the `FrameQuality` of the first stage that measured them, so the
+ * stages after it do not measure them again.
+ */
 class ImageBuffer
 {
 private:
     ImageFormat format;
-    std::unique_ptr<char[]> buffer;
+    PooledBuffer buffer;
     size_t bufferSize;
+    std::chrono::steady_clock::time_point captured = std::chrono::steady_clock::now();
+    std::shared_ptr<const FrameQuality> quality;
 
 public:
     ImageBuffer(const void *databuffer, uint32_t size, const ImageFormat format);
-    ImageBuffer(const ImageBuffer &other);
-    ImageBuffer &operator=(const ImageBuffer &other);
+    ImageBuffer(std::unique_ptr<char[]> databuffer, uint32_t size, const ImageFormat format);
+    ImageBuffer(PooledBuffer databuffer, uint32_t size, const ImageFormat format);
+    ImageBuffer(const ImageBuffer &other) = delete;
+    ImageBuffer &operator=(const ImageBuffer &other) = delete;
     ImageBuffer(ImageBuffer &&other) noexcept;
     ImageBuffer &operator=(ImageBuffer &&other) noexcept;
     ~ImageBuffer() = default;
     const ImageFormat &getFormat() const;
     const void *getData() const;
     size_t getSize() const;
+    std::chrono::steady_clock::time_point getCaptureTime() const;
+    void setCaptureTime(std::chrono::steady_clock::time_point time);
+    const FrameQuality *getQuality() const;
+    void setQuality(std::shared_ptr<const FrameQuality> quality);
 
     std::unique_ptr<ImageBuffer> resizeTo(unsigned int newWidth, unsigned int newHeight) const;
     std::unique_ptr<ImageBuffer> cropImage(double x0, double y0, double x1, double y1) const;
+    ImageView view() const;
+    ImageView cropView(double x0, double y0, double x1, double y1) const;
     cv::Mat to_mat();
 };
 
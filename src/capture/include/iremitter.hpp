@@ -0,0 +1,123 @@
+#ifndef IR_EMITTER_HPP
+#define IR_EMITTER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "framequality.hpp"
+#include "framesource.hpp"
+
+/**
+ * @brief The UVC extension unit control that turns on the IR emitter of a camera.
+ *
+ * Windows Hello cameras often leave the emitter off under Linux until a vendor
+ * specific control is set. Which unit, selector and value that is differs between
+ * models, so it comes from a config file with one section per camera:
+ *
+ *     [Integrated IR Camera]
+ *     unit = 14
+ *     selector = 6
+ *     value = 1, 3, 3, 0, 0, 0, 0, 0, 0
+ *
+ * The section name is either the device path or the card name the driver reports.
+ */
+struct EmitterControl
+{
+    std::string device;
+    uint8_t unit = 0;
+    uint8_t selector = 0;
+    std::vector<uint8_t> value;
+
+    static std::vector<EmitterControl> load(const std::string &path);
+    static std::string defaultPath();
+};
+
+/**
+ * @brief Keeps the emitter controls of the cameras and sets them when a camera
+ * starts streaming.
+ *
+ * The control of a device is looked up and checked against the device once, and
+ * remembered for the lifetime of the program, like whether it has none at all.
+ * This is a singleton object; the controls are read from `EmitterControl::defaultPath()`
+ * unless `configure()` says otherwise.
+ */
+class EmitterRegistry
+{
+private:
+    std::mutex lock;
+    std::vector<EmitterControl> controls;
+    std::map<std::string, std::optional<EmitterControl>> discovered;
+
+    EmitterRegistry();
+
+public:
+    EmitterRegistry(const EmitterRegistry &) = delete;
+    EmitterRegistry &operator=(const EmitterRegistry &) = delete;
+
+    static EmitterRegistry &getInstance()
+    {
+        static EmitterRegistry instance;
+        return instance;
+    }
+
+    void configure(std::vector<EmitterControl> controls);
+    bool configured(const std::string &path, const std::string &card);
+
+    /**
+     * The emitter control of an open device, if it has one that the device accepts.
+     */
+    std::optional<EmitterControl> discover(int fd, const std::string &path, const std::string &card);
+
+    /**
+     * Turn on the emitter of an open device. Devices without a control are left alone.
+     *
+     * @returns Whether a control was set.
+     */
+    bool enable(int fd, const std::string &path, const std::string &card);
+};
+
+/**
+ * @brief What a `LitFrameStream` did with the frames of its stream.
+ */
+struct LitFrameStats
+{
+    int frames = 0;
+    // Frames skipped because the emitter was off.
+    int dropped = 0;
+};
+
+/**
+ * @brief Hands out only the frames of a stream that were lit by the IR emitter.
+ *
+ * Emitters that light every other frame leave half the frames of a stream dark.
+ * Skipping those right at the source keeps them out of the queue in front of the
+ * DNNs, where they would push out lit frames. Streams that are lit throughout pass
+ * unchanged. If the emitter seems to stay off, every `max_skipped`-th dark frame is
+ * handed out anyway, so the consumer still sees what the camera sees.
+ */
+class LitFrameStream : public FrameStream
+{
+private:
+    std::unique_ptr<FrameStream> stream;
+    EmitterPhase emitter;
+    int max_skipped;
+    LitFrameStats stats;
+
+public:
+    explicit LitFrameStream(std::unique_ptr<FrameStream> stream, const QualityConfig &config = {}, int max_skipped = 3);
+
+    const ImageFormat &getFormat() const override;
+    std::unique_ptr<ImageBuffer> next() override;
+    std::unique_ptr<ImageBuffer> nextBefore(std::chrono::steady_clock::time_point deadline) override;
+    void flush() override;
+
+    const LitFrameStats &getStats() const;
+};
+
+#endif
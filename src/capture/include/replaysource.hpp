@@ -0,0 +1,55 @@
+#ifndef REPLAY_SOURCE_HPP
+#define REPLAY_SOURCE_HPP
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "framesource.hpp"
+#include "image.hpp"
+
+/**
+ * @brief Replays recorded frames as if they came from a camera.
+ *
+ * The recording is either a directory of images (read in name order, single
+ * channel images stay luma), or a raw capture file written by `RawCaptureWriter`.
+ * Frames are paced at a fixed interval to mimic the frame rate of a real sensor,
+ * which makes the whole capture -> detect -> embed pipeline reproducible on
+ * machines without a camera.
+ */
+class ReplaySource : public FrameSource
+{
+private:
+    std::string path;
+    std::chrono::microseconds interval;
+    bool loop;
+
+public:
+    explicit ReplaySource(const std::string &path,
+                          std::chrono::microseconds interval = std::chrono::microseconds(0),
+                          bool loop = false);
+
+    const std::string getPath() const override;
+    std::unique_ptr<FrameStream> open(const ImageFormat &format) const override;
+};
+
+/**
+ * @brief Records frames into a raw capture file that `ReplaySource` can play back.
+ *
+ * All frames of a file share the format of the first one.
+ */
+class RawCaptureWriter
+{
+private:
+    std::ofstream file;
+    ImageFormat format;
+
+public:
+    RawCaptureWriter(const std::string &path, const ImageFormat &format);
+
+    void write(const ImageBuffer &image);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef RESIZE_HPP
+#define RESIZE_HPP
+
+#include <cstddef>
+
+#include "image.hpp"
+
+/**
+ * @brief How pixels are resampled. `Auto` uses an area filter when shrinking by
+ * at least half in both directions, and bilinear interpolation otherwise.
+ */
+enum class ResizeFilter
+{
+    Auto,
+    Bilinear,
+    Area
+};
+
+/**
+ * @brief The instruction set used for the row passes of 8-bit images.
+ * 16-bit images always use the scalar kernels.
+ */
+enum class ResizeKernel
+{
+    Scalar,
+    AVX2
+};
+
+ResizeKernel bestResizeKernel();
+
+/**
+ * @brief Resize the pixels of a view into a caller provided buffer.
+ *
+ * The output has the layout of the source (luma stays single channel, nothing
+ * is gamma corrected) and `width` x `height` pixels with `stride` bytes per row.
+ * Both passes run in fixed point, the separable bilinear kernel interpolates
+ * between pixel centers like `cv::INTER_LINEAR` and the area kernel averages
+ * the box of source pixels every output pixel covers.
+ */
+void resize_into(const ImageView &source, void *output, unsigned int width, unsigned int height, size_t stride,
+                 ResizeFilter filter = ResizeFilter::Auto, ResizeKernel kernel = bestResizeKernel());
+
+#endif
@@ -18,11 +18,13 @@
 #include <string.h>
 
 #include "image.hpp"
+#include "capturesession.hpp"
+#include "framesource.hpp"
 
 /**
  * @brief Video Device Entry in the system. The path is ensured to exist.
  */
-class VideoDevice
+class VideoDevice : public FrameSource
 {
 private:
     std::string camera_path;
@@ -34,9 +36,11 @@ private:
 public:
     explicit VideoDevice(const std::string &camera_path);
     bool isCaptureDevice() const;
-    const std::string getPath() const;
+    const std::string getPath() const override;
+    bool hasEmitterControl() const;
     std::vector<v4l2_pix_format> getAvailableFormats() const;
-    std::unique_ptr<ImageBuffer> grab(const ImageFormat&) const;
+    std::unique_ptr<FrameStream> open(const ImageFormat&) const override;
+    std::unique_ptr<CaptureSession> startSession(const ImageFormat&) const;
 };
 
 
@@ -0,0 +1,86 @@
+#ifndef WARMUP_HPP
+#define WARMUP_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "image.hpp"
+
+/**
+ * @brief Cheap luma statistics of a frame, taken on a sparse grid of pixels.
+ * `valid` is false for formats whose luma cannot be read without decoding (MJPG).
+ */
+struct FrameStats
+{
+    static constexpr size_t BINS = 16;
+
+    bool valid = false;
+    // Mean luma, scaled to 0..255 whatever the bit depth of the frame.
+    double mean = 0;
+    // Fraction of the sampled pixels in each of the luma bins.
+    std::array<float, BINS> histogram = {};
+
+    static FrameStats measure(const void *data, const ImageFormat &format, size_t stride);
+};
+
+/**
+ * @brief Knobs of the warm-up detection.
+ */
+struct WarmupConfig
+{
+    // Accept the frame once this many frames were looked at, settled or not.
+    int max_frames = 15;
+    // Frames without luma statistics or exposure metadata are skipped by count, unless
+    // the picture need not settle.
+    int blind_frames = 8;
+    // Frames darker than this mean luma are never accepted (sensor or emitter not up yet).
+    double dark_mean = 8;
+    // Largest change in mean luma between two frames that still counts as settled.
+    double mean_tolerance = 4;
+    // Largest L1 distance between the histograms of two settled frames.
+    double histogram_tolerance = 0.15;
+    // Whether the picture has to settle, or the first usable frame is good enough.
+    // IR cameras light the scene themselves and do not need to settle.
+    bool require_stable = true;
+};
+
+/**
+ * @brief How a capture session warmed up.
+ */
+struct WarmupStats
+{
+    int frames_skipped = 0;
+    std::chrono::microseconds elapsed{0};
+    // False if the frame was accepted only because `max_frames` was reached.
+    bool settled = false;
+};
+
+/**
+ * @brief Decides when a freshly started camera delivers usable frames.
+ *
+ * Instead of dropping a fixed number of frames, each frame is compared to the one
+ * before it: once the mean luma, the luma histogram and the exposure reported by
+ * the driver stop changing, auto exposure has settled and the frame is accepted.
+ * Sensors that start up settled lose a single frame, slow ones get as many as
+ * they need, up to `max_frames`.
+ */
+class WarmupDetector
+{
+private:
+    WarmupConfig config;
+    FrameStats previous;
+    int64_t previous_exposure = -1;
+    int seen = 0;
+    bool settled = false;
+
+public:
+    explicit WarmupDetector(const WarmupConfig &config = {});
+
+    bool accept(const FrameStats &stats, int64_t exposure = -1);
+    int skipped() const;
+    bool isSettled() const;
+};
+
+#endif
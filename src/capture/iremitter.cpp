@@ -0,0 +1,244 @@
+#include "iremitter.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <linux/usb/video.h>
+#include <linux/uvcvideo.h>
+#include "libv4l2.h"
+#include "spdlog/spdlog.h"
+
+static std::string trim(const std::string &value)
+{
+    auto begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return "";
+    auto end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+static uint8_t parse_byte(const std::string &value)
+{
+    int byte = std::stoi(value, nullptr, 0);
+    if (byte < 0 || byte > 255)
+        throw std::runtime_error("Not a byte in emitter config: " + value);
+    return static_cast<uint8_t>(byte);
+}
+
+/**
+ * Read an emitter config file. Unknown keys are an error, since a wrong control
+ * can leave the camera in an odd state.
+ */
+std::vector<EmitterControl> EmitterControl::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Could not read emitter config: " + path);
+
+    std::vector<EmitterControl> controls;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+
+        if (line.front() == '[' && line.back() == ']')
+        {
+            controls.push_back(EmitterControl{.device = trim(line.substr(1, line.size() - 2))});
+            continue;
+        }
+
+        auto separator = line.find('=');
+        if (separator == std::string::npos || controls.empty())
+            throw std::runtime_error("Malformed emitter config line: " + line);
+
+        EmitterControl &control = controls.back();
+        std::string key = trim(line.substr(0, separator));
+        std::string value = trim(line.substr(separator + 1));
+
+        if (key == "unit")
+            control.unit = parse_byte(value);
+        else if (key == "selector")
+            control.selector = parse_byte(value);
+        else if (key == "value")
+        {
+            std::stringstream bytes(value);
+            std::string byte;
+            control.value.clear();
+            while (std::getline(bytes, byte, ','))
+                control.value.push_back(parse_byte(trim(byte)));
+        }
+        else
+            throw std::runtime_error("Unknown emitter config key: " + key);
+    }
+
+    for (const auto &control : controls)
+    {
+        if (control.value.empty())
+            throw std::runtime_error("Emitter control without a value: " + control.device);
+    }
+    return controls;
+}
+
+/**
+ * The emitter config of the system, `IRPAM_EMITTER_CONFIG` if set.
+ */
+std::string EmitterControl::defaultPath()
+{
+    const char *path = std::getenv("IRPAM_EMITTER_CONFIG");
+    return path ? path : "/etc/irpam/emitters.conf";
+}
+
+EmitterRegistry::EmitterRegistry()
+{
+    std::string path = EmitterControl::defaultPath();
+    if (!std::filesystem::exists(path))
+        return;
+
+    try
+    {
+        controls = EmitterControl::load(path);
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::warn("Ignoring emitter config: {}", e.what());
+    }
+}
+
+/**
+ * Whether the config has an emitter control for a device, whether or not the
+ * device accepts it.
+ */
+bool EmitterRegistry::configured(const std::string &path, const std::string &card)
+{
+    std::lock_guard guard(lock);
+    for (const auto &control : controls)
+    {
+        if (control.device == path || control.device == card)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Replace the emitter controls, and forget what was discovered with the old ones.
+ */
+void EmitterRegistry::configure(std::vector<EmitterControl> controls)
+{
+    std::lock_guard guard(lock);
+    this->controls = std::move(controls);
+    discovered.clear();
+}
+
+static int query_control(int fd, const EmitterControl &control, uint8_t query, uint8_t *data, uint16_t size)
+{
+    uvc_xu_control_query xu = {};
+    xu.unit = control.unit;
+    xu.selector = control.selector;
+    xu.query = query;
+    xu.size = size;
+    xu.data = data;
+    return v4l2_ioctl(fd, UVCIOC_CTRL_QUERY, &xu);
+}
+
+std::optional<EmitterControl> EmitterRegistry::discover(int fd, const std::string &path, const std::string &card)
+{
+    std::lock_guard guard(lock);
+    auto cached = discovered.find(path);
+    if (cached != discovered.end())
+        return cached->second;
+
+    std::optional<EmitterControl> found;
+    for (const auto &control : controls)
+    {
+        if (control.device != path && control.device != card)
+            continue;
+
+        // The device must know the control, and agree on its size.
+        uint8_t length[2] = {};
+        if (query_control(fd, control, UVC_GET_LEN, length, sizeof(length)) < 0)
+        {
+            spdlog::warn("{} has no emitter control at unit {} selector {}: {}", path, control.unit,
+                         control.selector, strerror(errno));
+            break;
+        }
+        size_t size = length[0] | (length[1] << 8);
+        if (size != control.value.size())
+        {
+            spdlog::warn("The emitter control of {} takes {} bytes, not {}", path, size, control.value.size());
+            break;
+        }
+
+        spdlog::info("IR emitter of {} is at unit {} selector {}", path, control.unit, control.selector);
+        found = control;
+        break;
+    }
+
+    discovered[path] = found;
+    return found;
+}
+
+bool EmitterRegistry::enable(int fd, const std::string &path, const std::string &card)
+{
+    auto control = discover(fd, path, card);
+    if (!control.has_value())
+        return false;
+
+    std::vector<uint8_t> value = control->value;
+    if (query_control(fd, control.value(), UVC_SET_CUR, value.data(), static_cast<uint16_t>(value.size())) < 0)
+    {
+        spdlog::warn("Could not turn on the IR emitter of {}: {}", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+LitFrameStream::LitFrameStream(std::unique_ptr<FrameStream> stream, const QualityConfig &config, int max_skipped)
+    : stream(std::move(stream)), emitter(config), max_skipped(max_skipped)
+{
+}
+
+const ImageFormat &LitFrameStream::getFormat() const
+{
+    return stream->getFormat();
+}
+
+void LitFrameStream::flush()
+{
+    stream->flush();
+}
+
+const LitFrameStats &LitFrameStream::getStats() const
+{
+    return stats;
+}
+
+/**
+ * Get the next frame the emitter was on for. Frames that cannot be measured
+ * (encoded ones) are always handed out. The frames keep their measurement, for
+ * the quality gate further down.
+ */
+std::unique_ptr<ImageBuffer> LitFrameStream::next()
+{
+    return nextBefore(std::chrono::steady_clock::time_point::max());
+}
+
+std::unique_ptr<ImageBuffer> LitFrameStream::nextBefore(std::chrono::steady_clock::time_point deadline)
+{
+    for (int skipped = 0;; skipped++)
+    {
+        auto frame = stream->nextBefore(deadline);
+        if (!frame)
+            return nullptr;
+        stats.frames++;
+
+        auto quality = std::make_shared<const FrameQuality>(FrameQuality::measure(*frame));
+        frame->setQuality(quality);
+        if (!quality->valid || !emitter.isOff(quality->mean) || skipped >= max_skipped)
+            return frame;
+        stats.dropped++;
+    }
+}
@@ -0,0 +1,198 @@
+#include "replaysource.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+static const char RAW_MAGIC[4] = {'I', 'R', 'P', 'R'};
+static const uint32_t RAW_VERSION = 1;
+
+struct RawHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_size;
+};
+
+/**
+ * @brief Base of the replay streams: hands out frames at a fixed pace.
+ */
+class ReplayStream : public FrameStream
+{
+private:
+    std::chrono::microseconds interval;
+    std::chrono::steady_clock::time_point due;
+
+protected:
+    bool loop;
+    ImageFormat format = {};
+
+    virtual std::unique_ptr<ImageBuffer> read() = 0;
+
+public:
+    ReplayStream(std::chrono::microseconds interval, bool loop)
+        : interval(interval), due(std::chrono::steady_clock::now()), loop(loop) {}
+
+    const ImageFormat &getFormat() const override { return format; }
+
+    std::unique_ptr<ImageBuffer> next() override
+    {
+        // Keep a steady frame rate, like a sensor would, instead of sleeping a
+        // fixed amount after however long the consumer took.
+        if (interval.count() > 0)
+        {
+            std::this_thread::sleep_until(due);
+            due = std::max(due + interval, std::chrono::steady_clock::now());
+        }
+        return read();
+    }
+};
+
+class RawReplayStream : public ReplayStream
+{
+private:
+    std::ifstream file;
+    RawHeader header;
+
+protected:
+    std::unique_ptr<ImageBuffer> read() override
+    {
+        auto data = FramePool::getInstance().acquire(header.frame_size);
+        if (!file.read(data.get(), header.frame_size))
+        {
+            if (!loop || file.gcount() != 0)
+                throw std::runtime_error("End of replay");
+
+            file.clear();
+            file.seekg(sizeof(RawHeader));
+            if (!file.read(data.get(), header.frame_size))
+                throw std::runtime_error("Replay has no frames");
+        }
+        return std::make_unique<ImageBuffer>(std::move(data), header.frame_size, format);
+    }
+
+public:
+    RawReplayStream(const std::string &path, std::chrono::microseconds interval, bool loop)
+        : ReplayStream(interval, loop), file(path, std::ios::binary)
+    {
+        if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, RAW_MAGIC, sizeof(RAW_MAGIC)) != 0 || header.version != RAW_VERSION)
+            throw std::runtime_error("Not a raw capture file: " + path);
+
+        format = ImageFormat::fromFourcc(header.fourcc, header.width, header.height);
+        if (format.buffersize != header.frame_size)
+            throw std::runtime_error("Raw capture file has an unsupported frame layout: " + path);
+    }
+};
+
+class DirectoryReplayStream : public ReplayStream
+{
+private:
+    std::vector<std::string> files;
+    size_t position = 0;
+
+protected:
+    std::unique_ptr<ImageBuffer> read() override
+    {
+        if (position == files.size())
+        {
+            if (!loop)
+                throw std::runtime_error("End of replay");
+            position = 0;
+        }
+
+        cv::Mat image = cv::imread(files[position++], cv::IMREAD_UNCHANGED);
+        if (image.empty())
+            throw std::runtime_error("Could not read replay frame: " + files[position - 1]);
+
+        uint32_t fourcc;
+        if (image.channels() == 1)
+        {
+            fourcc = image.depth() == CV_16U ? V4L2_PIX_FMT_Y16 : V4L2_PIX_FMT_GREY;
+        }
+        else
+        {
+            cv::cvtColor(image, image, image.channels() == 4 ? cv::COLOR_BGRA2RGB : cv::COLOR_BGR2RGB);
+            fourcc = V4L2_PIX_FMT_RGB24;
+        }
+
+        format = ImageFormat::fromFourcc(fourcc, image.cols, image.rows);
+        cv::Mat packed = image.isContinuous() ? image : image.clone();
+        return std::make_unique<ImageBuffer>(packed.data, format.buffersize, format);
+    }
+
+public:
+    DirectoryReplayStream(const std::string &path, std::chrono::microseconds interval, bool loop)
+        : ReplayStream(interval, loop)
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(path))
+        {
+            if (entry.is_regular_file())
+                files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+
+        if (files.empty())
+            throw std::runtime_error("Replay directory is empty: " + path);
+
+        // Peek at the first frame so the stream can report its format up front.
+        read();
+        position = 0;
+    }
+};
+
+ReplaySource::ReplaySource(const std::string &path, std::chrono::microseconds interval, bool loop)
+    : path(path), interval(interval), loop(loop)
+{
+    if (!std::filesystem::exists(path))
+        throw std::runtime_error("Replay path does not exist: " + path);
+}
+
+const std::string ReplaySource::getPath() const
+{
+    return this->path;
+}
+
+/**
+ * Start replaying. The recorded format always wins over the requested one.
+ */
+std::unique_ptr<FrameStream> ReplaySource::open(const ImageFormat &) const
+{
+    if (std::filesystem::is_directory(path))
+        return std::make_unique<DirectoryReplayStream>(path, interval, loop);
+
+    return std::make_unique<RawReplayStream>(path, interval, loop);
+}
+
+RawCaptureWriter::RawCaptureWriter(const std::string &path, const ImageFormat &format)
+    : file(path, std::ios::binary | std::ios::trunc), format(format)
+{
+    if (!file)
+        throw std::runtime_error("Could not open raw capture file for writing: " + path);
+
+    if (format.layout == PixelLayout::Encoded)
+        throw std::runtime_error("Raw capture files only hold uncompressed frames");
+
+    RawHeader header = {
+        .magic = {},
+        .version = RAW_VERSION,
+        .fourcc = format.fourcc,
+        .width = format.width,
+        .height = format.height,
+        .frame_size = static_cast<uint32_t>(format.buffersize)};
+    std::memcpy(header.magic, RAW_MAGIC, sizeof(RAW_MAGIC));
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+void RawCaptureWriter::write(const ImageBuffer &image)
+{
+    const ImageFormat &frame_format = image.getFormat();
+    if (frame_format.fourcc != format.fourcc || frame_format.width != format.width || frame_format.height != format.height)
+        throw std::runtime_error("All frames of a raw capture file must share one format");
+
+    file.write(static_cast<const char *>(image.getData()), image.getSize());
+    if (!file)
+        throw std::runtime_error("Could not write raw capture frame");
+}
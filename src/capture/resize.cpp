@@ -0,0 +1,296 @@
+#include "resize.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESIZE_X86 1
+#endif
+
+// Bilinear weights are 7-bit fixed point, so a horizontally interpolated 8-bit
+// row still fits into int16 and two rows blend with a single multiply-add.
+#define WEIGHT_BITS 7
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+/**
+ * Intermediate types per pixel type: `Row` holds a horizontally interpolated
+ * row, `Sum` the column sums of the area filter.
+ */
+template <typename T>
+struct ResizeTraits;
+
+template <>
+struct ResizeTraits<uint8_t>
+{
+    using Row = int16_t;
+    using Sum = uint32_t;
+};
+
+template <>
+struct ResizeTraits<uint16_t>
+{
+    using Row = int32_t;
+    using Sum = uint64_t;
+};
+
+// The two source samples an output sample is interpolated from, and the weight of the second.
+struct LinearTap
+{
+    int first;
+    int second;
+    int weight;
+};
+
+// The half-open range of source samples an output sample averages.
+struct BoxTap
+{
+    int first;
+    int last;
+};
+
+static void linear_taps(std::vector<LinearTap> &taps, unsigned int source, unsigned int target, int step)
+{
+    taps.resize(target);
+    double scale = static_cast<double>(source) / target;
+    for (unsigned int i = 0; i < target; i++)
+    {
+        double position = std::clamp((i + 0.5) * scale - 0.5, 0.0, source - 1.0);
+        int first = static_cast<int>(position);
+        int second = std::min<int>(first + 1, source - 1);
+        taps[i] = LinearTap{
+            .first = first * step,
+            .second = second * step,
+            .weight = static_cast<int>(std::lround((position - first) * WEIGHT_ONE))};
+    }
+}
+
+static void box_taps(std::vector<BoxTap> &taps, unsigned int source, unsigned int target)
+{
+    taps.resize(target);
+    for (unsigned int i = 0; i < target; i++)
+    {
+        int first = static_cast<int>(static_cast<uint64_t>(i) * source / target);
+        int last = static_cast<int>(static_cast<uint64_t>(i + 1) * source / target);
+        taps[i] = BoxTap{.first = first, .last = std::max(last, first + 1)};
+    }
+}
+
+template <typename T, int CHANNELS>
+static void interpolate_row(const T *source, typename ResizeTraits<T>::Row *row, const std::vector<LinearTap> &taps)
+{
+    for (size_t x = 0; x < taps.size(); x++)
+    {
+        const LinearTap &tap = taps[x];
+        for (int c = 0; c < CHANNELS; c++)
+            row[x * CHANNELS + c] = source[tap.first + c] * (WEIGHT_ONE - tap.weight) + source[tap.second + c] * tap.weight;
+    }
+}
+
+template <typename T, typename Row>
+static void blend_rows(const Row *first, const Row *second, int weight, T *output, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t value = static_cast<int64_t>(first[i]) * (WEIGHT_ONE - weight) + static_cast<int64_t>(second[i]) * weight;
+        output[i] = static_cast<T>((value + (1 << (2 * WEIGHT_BITS - 1))) >> (2 * WEIGHT_BITS));
+    }
+}
+
+template <typename T, typename Sum>
+static void accumulate_row(const T *row, Sum *sums, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        sums[i] += row[i];
+}
+
+#ifdef RESIZE_X86
+__attribute__((target("avx2"))) static void blend_rows_avx2(const int16_t *first, const int16_t *second, int weight, uint8_t *output, size_t count)
+{
+    // Each 32-bit lane holds the (first, second) weight pair for `madd`.
+    const __m256i weights = _mm256_set1_epi32((weight << 16) | (WEIGHT_ONE - weight));
+    const __m256i round = _mm256_set1_epi32(1 << (2 * WEIGHT_BITS - 1));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(second + i));
+        __m256i low = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights);
+        __m256i high = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights);
+        low = _mm256_srai_epi32(_mm256_add_epi32(low, round), 2 * WEIGHT_BITS);
+        high = _mm256_srai_epi32(_mm256_add_epi32(high, round), 2 * WEIGHT_BITS);
+
+        // The unpacks work per 128-bit lane, packing them back restores the order.
+        __m256i words = _mm256_packs_epi32(low, high);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm256_castsi256_si128(bytes));
+    }
+    blend_rows(first + i, second + i, weight, output + i, count - i);
+}
+
+__attribute__((target("avx2"))) static void accumulate_row_avx2(const uint8_t *row, uint32_t *sums, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        __m256i *low = reinterpret_cast<__m256i *>(sums + i);
+        __m256i *high = reinterpret_cast<__m256i *>(sums + i + 8);
+        _mm256_storeu_si256(low, _mm256_add_epi32(_mm256_loadu_si256(low), _mm256_cvtepu8_epi32(bytes)));
+        _mm256_storeu_si256(high, _mm256_add_epi32(_mm256_loadu_si256(high), _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))));
+    }
+    accumulate_row(row + i, sums + i, count - i);
+}
+#endif
+
+template <typename T, int CHANNELS>
+static void resize_bilinear(const ImageView &source, char *output, unsigned int width, unsigned int height, size_t stride, ResizeKernel kernel)
+{
+    using Row = typename ResizeTraits<T>::Row;
+
+    // Scratch space is kept per thread, so resizing a stream does not allocate.
+    static thread_local std::vector<LinearTap> columns;
+    static thread_local std::vector<LinearTap> rows;
+    static thread_local std::vector<Row> cache[2];
+
+    const ImageFormat &format = source.getFormat();
+    linear_taps(columns, format.width, width, CHANNELS);
+    linear_taps(rows, format.height, height, 1);
+
+    size_t count = static_cast<size_t>(width) * CHANNELS;
+    cache[0].resize(count);
+    cache[1].resize(count);
+    int cached[2] = {-1, -1};
+
+    // Interpolated source rows are reused as long as consecutive output rows need them.
+    auto fetch = [&](int row, int keep) -> const Row *
+    {
+        for (int slot = 0; slot < 2; slot++)
+            if (cached[slot] == row)
+                return cache[slot].data();
+
+        int slot = cached[0] == keep ? 1 : 0;
+        interpolate_row<T, CHANNELS>(static_cast<const T *>(source.row(row)), cache[slot].data(), columns);
+        cached[slot] = row;
+        return cache[slot].data();
+    };
+
+    for (unsigned int y = 0; y < height; y++)
+    {
+        const LinearTap &tap = rows[y];
+        const Row *first = fetch(tap.first, tap.second);
+        const Row *second = fetch(tap.second, tap.first);
+        T *target = reinterpret_cast<T *>(output + y * stride);
+
+#ifdef RESIZE_X86
+        if constexpr (std::is_same_v<T, uint8_t>)
+        {
+            if (kernel == ResizeKernel::AVX2)
+            {
+                blend_rows_avx2(first, second, tap.weight, target, count);
+                continue;
+            }
+        }
+#endif
+        blend_rows(first, second, tap.weight, target, count);
+    }
+}
+
+template <typename T, int CHANNELS>
+static void resize_area(const ImageView &source, char *output, unsigned int width, unsigned int height, size_t stride, ResizeKernel kernel)
+{
+    using Sum = typename ResizeTraits<T>::Sum;
+
+    static thread_local std::vector<BoxTap> columns;
+    static thread_local std::vector<BoxTap> rows;
+    static thread_local std::vector<Sum> sums;
+
+    const ImageFormat &format = source.getFormat();
+    box_taps(columns, format.width, width);
+    box_taps(rows, format.height, height);
+
+    size_t count = static_cast<size_t>(format.width) * CHANNELS;
+    sums.resize(count);
+
+    for (unsigned int y = 0; y < height; y++)
+    {
+        const BoxTap &box = rows[y];
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int row = box.first; row < box.last; row++)
+        {
+            auto pixels = static_cast<const T *>(source.row(row));
+#ifdef RESIZE_X86
+            if constexpr (std::is_same_v<T, uint8_t>)
+            {
+                if (kernel == ResizeKernel::AVX2)
+                {
+                    accumulate_row_avx2(pixels, sums.data(), count);
+                    continue;
+                }
+            }
+#endif
+            accumulate_row(pixels, sums.data(), count);
+        }
+
+        T *target = reinterpret_cast<T *>(output + y * stride);
+        for (unsigned int x = 0; x < width; x++)
+        {
+            const BoxTap &column = columns[x];
+            double scale = 1.0 / ((column.last - column.first) * (box.last - box.first));
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                Sum sum = 0;
+                for (int i = column.first; i < column.last; i++)
+                    sum += sums[i * CHANNELS + c];
+                target[x * CHANNELS + c] = static_cast<T>(sum * scale + 0.5);
+            }
+        }
+    }
+}
+
+/**
+ * Pick the widest kernel the CPU can run.
+ */
+ResizeKernel bestResizeKernel()
+{
+#ifdef RESIZE_X86
+    if (__builtin_cpu_supports("avx2"))
+        return ResizeKernel::AVX2;
+#endif
+    return ResizeKernel::Scalar;
+}
+
+void resize_into(const ImageView &source, void *output, unsigned int width, unsigned int height, size_t stride,
+                 ResizeFilter filter, ResizeKernel kernel)
+{
+    const ImageFormat &format = source.getFormat();
+    if (width == 0 || height == 0 || format.width == 0 || format.height == 0)
+        throw std::runtime_error("Cannot resize from or to an empty image");
+
+    if (filter == ResizeFilter::Auto)
+        filter = format.width >= 2 * width && format.height >= 2 * height ? ResizeFilter::Area : ResizeFilter::Bilinear;
+
+    bool area = filter == ResizeFilter::Area;
+    auto target = static_cast<char *>(output);
+    switch (format.layout)
+    {
+    case PixelLayout::Grey:
+        area ? resize_area<uint8_t, 1>(source, target, width, height, stride, kernel)
+             : resize_bilinear<uint8_t, 1>(source, target, width, height, stride, kernel);
+        break;
+    case PixelLayout::RGB24:
+        area ? resize_area<uint8_t, 3>(source, target, width, height, stride, kernel)
+             : resize_bilinear<uint8_t, 3>(source, target, width, height, stride, kernel);
+        break;
+    case PixelLayout::Y16:
+        area ? resize_area<uint16_t, 1>(source, target, width, height, stride, kernel)
+             : resize_bilinear<uint16_t, 1>(source, target, width, height, stride, kernel);
+        break;
+    default:
+        throw std::runtime_error("Cannot resize an encoded image");
+    }
+}
@@ -0,0 +1,136 @@
+#include "warmup.hpp"
+#include <cmath>
+
+// Statistics are taken on every STEP-th pixel of every STEP-th row.
+#define STATS_STEP 8
+
+/**
+ * Read the luma of a frame on a sparse grid. Luma formats are read as they are,
+ * RGB24 is weighted roughly like BT.601 and packed YUV formats use their Y bytes.
+ */
+FrameStats FrameStats::measure(const void *data, const ImageFormat &format, size_t stride)
+{
+    FrameStats stats;
+    auto pixels = static_cast<const unsigned char *>(data);
+
+    size_t pixel_bytes;
+    size_t luma_offset = 0;
+    switch (format.fourcc)
+    {
+    case V4L2_PIX_FMT_YUYV:
+        pixel_bytes = 2;
+        break;
+    case V4L2_PIX_FMT_UYVY:
+        pixel_bytes = 2;
+        luma_offset = 1;
+        break;
+    default:
+        pixel_bytes = format.bytesPerPixel();
+        break;
+    }
+
+    if (pixel_bytes == 0 || format.width == 0 || format.height == 0)
+        return stats;
+
+    std::array<uint32_t, BINS> counts = {};
+    uint64_t sum = 0;
+    uint32_t samples = 0;
+
+    for (unsigned int y = 0; y < format.height; y += STATS_STEP)
+    {
+        const unsigned char *row = pixels + y * stride + luma_offset;
+        for (unsigned int x = 0; x < format.width; x += STATS_STEP)
+        {
+            const unsigned char *pixel = row + x * pixel_bytes;
+            unsigned int luma;
+            switch (format.layout)
+            {
+            case PixelLayout::Y16:
+                luma = pixel[1];
+                break;
+            case PixelLayout::RGB24:
+                luma = (pixel[0] + 2 * pixel[1] + pixel[2]) / 4;
+                break;
+            default:
+                luma = pixel[0];
+                break;
+            }
+
+            sum += luma;
+            counts[luma * BINS / 256]++;
+            samples++;
+        }
+    }
+
+    stats.valid = true;
+    stats.mean = static_cast<double>(sum) / samples;
+    for (size_t bin = 0; bin < BINS; bin++)
+        stats.histogram[bin] = static_cast<float>(counts[bin]) / samples;
+    return stats;
+}
+
+WarmupDetector::WarmupDetector(const WarmupConfig &config)
+    : config(config)
+{
+}
+
+/**
+ * Look at the next frame of the stream.
+ *
+ * @param exposure The exposure the driver reports for the frame, or -1 if unknown.
+ * @returns Whether the frame is good to use. Once a frame was accepted, the
+ * detector should not be fed any more.
+ */
+bool WarmupDetector::accept(const FrameStats &stats, int64_t exposure)
+{
+    seen++;
+    bool usable = !stats.valid || stats.mean >= config.dark_mean;
+
+    bool stable;
+    if (!config.require_stable)
+    {
+        // IR cameras need no settling, not even when their frames cannot be measured.
+        stable = true;
+    }
+    else if (!stats.valid && exposure < 0)
+    {
+        // Nothing to judge the frame by, fall back to skipping a fixed number.
+        stable = seen > config.blind_frames;
+    }
+    else if (seen == 1)
+    {
+        stable = false;
+    }
+    else
+    {
+        stable = exposure == previous_exposure;
+        if (stats.valid && previous.valid)
+        {
+            float distance = 0;
+            for (size_t bin = 0; bin < FrameStats::BINS; bin++)
+                distance += std::fabs(stats.histogram[bin] - previous.histogram[bin]);
+
+            stable = stable && std::fabs(stats.mean - previous.mean) <= config.mean_tolerance &&
+                     distance <= config.histogram_tolerance;
+        }
+    }
+
+    previous = stats;
+    previous_exposure = exposure;
+
+    settled = usable && stable;
+    return settled || seen >= config.max_frames;
+}
+
+/**
+ * Number of frames thrown away before the accepted one.
+ */
+int WarmupDetector::skipped() const
+{
+    return seen > 0 ? seen - 1 : 0;
+}
+
+bool WarmupDetector::isSettled() const
+{
+    return settled;
+}
@@ -1,9 +1,144 @@
 #include "include/CLI11.hpp"
+#include <iostream>
+
+#include "authservice.hpp"
+#include "cameramanager.hpp"
+#include "recognition.hpp"
+#include "embeddingstore.hpp"
+#include "replaysource.hpp"
+
+/**
+ * Capture a number of faces of the user in front of the camera and add their
+ * embeddings to the user's enrolled samples. The camera, the models and the store
+ * are the ones the daemon uses, so the samples match what authentication sees.
+ */
+static int enroll(const std::string &user, const DaemonConfig &config, int samples, int max_frames)
+{
+    configure_recognition(config);
+
+    EmbeddingStore store(config.store_dir.empty() ? EmbeddingStore::defaultDirectory() : config.store_dir);
+    std::shared_ptr<FrameStream> stream = camera_opener(config)();
+
+    std::vector<cv::Mat> faces;
+    for (int frame = 0; frame < max_frames && faces.size() < static_cast<size_t>(samples); frame++)
+    {
+        auto image = stream->next()->to_mat();
+        auto face = extract_face(image);
+        if (!face.has_value())
+            continue;
+
+        faces.push_back(face.value());
+        std::cout << "Captured sample " << faces.size() << "/" << samples << std::endl;
+    }
+
+    if (faces.size() < static_cast<size_t>(samples))
+    {
+        std::cerr << "Only found a face in " << faces.size() << " of " << max_frames << " frames" << std::endl;
+        return 1;
+    }
+
+    // All samples go through the embedding network in one batch.
+    store.append(user, face_embeddings(faces));
+    std::cout << "Enrolled " << faces.size() << " samples for " << user << std::endl;
+    return 0;
+}
+
+/**
+ * Record frames from the camera into a raw capture file, to be replayed later
+ * by benchmarks and tests on machines without a camera.
+ */
+static int record(const std::string &output, const std::string &camera, const ImageFormat &format, int frames)
+{
+    CameraManager &manager = CameraManager::getInstance();
+    std::shared_ptr<VideoDevice> device = camera.empty()
+                                              ? manager.get_camera_from_index(0)
+                                              : manager.get_camera_from_path(camera.c_str());
+
+    auto session = device->startSession(format);
+    RawCaptureWriter writer(output, session->getFormat());
+    for (int frame = 0; frame < frames; frame++)
+    {
+        writer.write(*session->next());
+    }
+
+    std::cout << "Recorded " << frames << " frames to " << output << std::endl;
+    return 0;
+}
 
 int main(int argc, char** argv)
 {
     using namespace CLI;
-    App app;
+    App app{"Configure IRPAM face authentication"};
+    app.require_subcommand(1);
+
+    std::string user;
+    std::string config_path = "/etc/irpam/irpamd.conf";
+    std::string camera;
+    std::string fourcc = "GREY";
+    unsigned int width = 640;
+    unsigned int height = 480;
+    int samples = 5;
+    int max_frames = 100;
+
+    auto enroll_cmd = app.add_subcommand("enroll", "Enroll the face of a user");
+    enroll_cmd->add_option("-u,--user", user, "User to enroll")->required();
+    enroll_cmd->add_option("--config", config_path, "Daemon config with the camera, models and store to use")->capture_default_str();
+    enroll_cmd->add_option("-c,--camera", camera, "Camera device path, e.g. /dev/video2 (default from the config)");
+    enroll_cmd->add_option("-f,--fourcc", fourcc, "Pixel format to capture (default from the config)");
+    enroll_cmd->add_option("--width", width, "Capture width (default from the config)");
+    enroll_cmd->add_option("--height", height, "Capture height (default from the config)");
+    enroll_cmd->add_option("-n,--samples", samples, "Number of face samples to enroll")->capture_default_str()->check(PositiveNumber);
+    enroll_cmd->add_option("--max-frames", max_frames, "Give up after this many frames")->capture_default_str()->check(PositiveNumber);
+
+    auto remove_cmd = app.add_subcommand("remove", "Remove all enrolled samples of a user");
+    remove_cmd->add_option("-u,--user", user, "User to remove")->required();
+    remove_cmd->add_option("--config", config_path, "Daemon config with the store to use")->capture_default_str();
+
+    std::string output;
+    int frames = 100;
+
+    auto record_cmd = app.add_subcommand("record", "Record raw frames for replaying them later");
+    record_cmd->add_option("-o,--output", output, "Raw capture file to write")->required();
+    record_cmd->add_option("-c,--camera", camera, "Camera device path, e.g. /dev/video2");
+    record_cmd->add_option("-f,--fourcc", fourcc, "Pixel format to capture")->capture_default_str();
+    record_cmd->add_option("--width", width, "Capture width")->capture_default_str();
+    record_cmd->add_option("--height", height, "Capture height")->capture_default_str();
+    record_cmd->add_option("-n,--frames", frames, "Number of frames to record")->capture_default_str()->check(PositiveNumber);
+
     CLI11_PARSE(app, argc, argv);
+
+    try
+    {
+        if (enroll_cmd->parsed())
+        {
+            DaemonConfig config = DaemonConfig::load(config_path);
+            if (enroll_cmd->count("--camera"))
+                config.camera = camera;
+            if (enroll_cmd->count("--fourcc"))
+                config.fourcc = fourcc;
+            if (enroll_cmd->count("--width"))
+                config.width = width;
+            if (enroll_cmd->count("--height"))
+                config.height = height;
+            return enroll(user, config, samples, max_frames);
+        }
+
+        if (record_cmd->parsed())
+        {
+            return record(output, camera, ImageFormat::fromFourcc(fourccFromString(fourcc), width, height), frames);
+        }
+
+        if (remove_cmd->parsed())
+        {
+            DaemonConfig config = DaemonConfig::load(config_path);
+            EmbeddingStore(config.store_dir.empty() ? EmbeddingStore::defaultDirectory() : config.store_dir).remove(user);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,291 @@
+#include "authservice.hpp"
+#include "cameramanager.hpp"
+#include "iremitter.hpp"
+#include "replaysource.hpp"
+#include "trace.hpp"
+#include "spdlog/spdlog.h"
+#include <fstream>
+#include <pwd.h>
+
+static std::string trim(const std::string &value)
+{
+    auto begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return "";
+    auto end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+/**
+ * Read the daemon config. A missing file just means all defaults.
+ */
+DaemonConfig DaemonConfig::load(const std::string &path)
+{
+    DaemonConfig config;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = trim(line.substr(0, line.find('#')));
+        auto separator = line.find('=');
+        if (line.empty() || separator == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, separator));
+        std::string value = trim(line.substr(separator + 1));
+
+        if (key == "socket")
+            config.socket = value;
+        else if (key == "camera")
+            config.camera = value;
+        else if (key == "fourcc")
+            config.fourcc = value;
+        else if (key == "width")
+            config.width = std::stoul(value);
+        else if (key == "height")
+            config.height = std::stoul(value);
+        else if (key == "emitter_config")
+            config.emitter_config = value;
+        else if (key == "lit_frames")
+            config.lit_frames = value == "true";
+        else if (key == "timeout")
+            config.timeout = std::stoi(value);
+        else if (key == "frames")
+            config.frames = std::stoi(value);
+        else if (key == "model_dir")
+            config.model_dir = value;
+        else if (key == "store_dir")
+            config.store_dir = value;
+        else if (key == "replay_interval")
+            config.replay_interval = std::stoi(value);
+        else if (key == "trace")
+            config.trace = value;
+        else if (key == "camera_idle")
+            config.camera_idle = std::stoi(value);
+        else if (key == "inference_threads")
+            config.inference.threads = std::stoi(value);
+        else if (key == "inference_cpus")
+            config.inference.cpus = InferenceConfig::parseCpuList(value);
+        else if (key == "inference_nice")
+            config.inference.nice = std::stoi(value);
+        else if (key == "track_template_frames")
+            config.tracking.template_frames = std::stoi(value);
+        else if (key == "track_window_scale")
+            config.tracking.window_scale = std::stof(value);
+        else if (key == "quality_dark_mean")
+            config.quality.dark_mean = std::stod(value);
+        else if (key == "quality_min_sharpness")
+            config.quality.min_sharpness = std::stod(value);
+        else if (key == "quality_emitter_off_ratio")
+            config.quality.emitter_off_ratio = std::stod(value);
+        else if (key == "detector_model")
+            config.detector_model = value;
+        else if (key == "embedding_model")
+            config.embedding_model = value;
+        else if (key == "model_accuracy")
+            config.model_accuracy = std::stof(value);
+        else
+            spdlog::warn("Unknown config key: {}", key);
+    }
+    return config;
+}
+
+ModelPaths choose_models(const DaemonConfig &config)
+{
+    ModelManifest manifest = ModelManifest::fromDirectory(
+        config.model_dir.empty() ? ModelManifest::defaultDirectory() : config.model_dir);
+
+    auto choose = [&](ModelRole role, const std::string &name)
+    {
+        if (name != "auto")
+            return manifest.choose(role, name, config.model_accuracy);
+
+        std::vector<ModelTiming> timings;
+        ModelSpec spec = select_fastest(manifest, role, config.model_accuracy, 5, &timings);
+        for (const auto &timing : timings)
+            spdlog::info("Model {} runs in {:.1f}ms", timing.name, timing.median_ms);
+        return spec;
+    };
+
+    ModelPaths paths{
+        .detector = choose(ModelRole::Detector, config.detector_model),
+        .embedder = choose(ModelRole::Embedder, config.embedding_model)};
+    spdlog::info("Using models {} ({}) and {} ({})", paths.detector.name, paths.detector.precision,
+                 paths.embedder.name, paths.embedder.precision);
+    return paths;
+}
+
+void configure_recognition(const DaemonConfig &config)
+{
+    if (!config.emitter_config.empty())
+        EmitterRegistry::getInstance().configure(EmitterControl::load(config.emitter_config));
+
+    ModelRegistry &registry = ModelRegistry::getInstance();
+    // Variants are timed under the thread budget they will run with.
+    registry.configureInference(config.inference);
+    registry.configure(choose_models(config));
+}
+
+/**
+ * Opener for the frame source named in the config: a V4L2 camera, or a replayed
+ * recording if the camera is given as `replay:<path>`.
+ */
+CameraOpener camera_opener(const DaemonConfig &config)
+{
+    return [config]() -> std::shared_ptr<FrameStream>
+    {
+        const std::string replay_prefix = "replay:";
+        std::shared_ptr<FrameSource> source;
+        bool lit_frames = config.lit_frames.value_or(false);
+        if (config.camera.rfind(replay_prefix, 0) == 0)
+        {
+            source = std::make_shared<ReplaySource>(config.camera.substr(replay_prefix.size()),
+                                                    std::chrono::milliseconds(config.replay_interval), true);
+        }
+        else
+        {
+            CameraManager &manager = CameraManager::getInstance();
+            auto device = config.camera.empty()
+                              ? manager.get_camera_from_index(0)
+                              : manager.get_camera_from_path(config.camera.c_str());
+            // Cameras that need their emitter turned on are the ones known to pulse it.
+            lit_frames = config.lit_frames.value_or(device->hasEmitterControl());
+            source = device;
+        }
+
+        auto format = ImageFormat::fromFourcc(fourccFromString(config.fourcc), config.width, config.height);
+        std::unique_ptr<FrameStream> opened = source->open(format);
+        if (lit_frames)
+            opened = std::make_unique<LitFrameStream>(std::move(opened), config.quality);
+        return std::shared_ptr<FrameStream>(std::move(opened));
+    };
+}
+
+AuthService::AuthService(const DaemonConfig &config, CameraOpener open_camera)
+    : config(config), open_camera(std::move(open_camera)),
+      store(config.store_dir.empty() ? EmbeddingStore::defaultDirectory() : config.store_dir,
+            EmbeddingOrigin::of(ModelRegistry::getInstance().getPaths()))
+{
+}
+
+/**
+ * Root may ask about anyone. Everybody else, e.g. a screen locker running PAM
+ * as the logged in user, may only ask about themselves.
+ */
+bool AuthService::may_request(const AuthRequest &request) const
+{
+    if (request.peer_uid == 0)
+        return true;
+
+    passwd entry;
+    passwd *result = nullptr;
+    char buffer[1024];
+    if (getpwnam_r(request.user.c_str(), &entry, buffer, sizeof(buffer), &result) != 0 || result == nullptr)
+        return false;
+
+    return result->pw_uid == request.peer_uid;
+}
+
+/**
+ * Get the matcher over the enrolled embeddings of a user, reading the store
+ * again only if it changed since the last request.
+ */
+std::shared_ptr<EmbeddingMatcher> AuthService::enrolled(const std::string &user)
+{
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(store.pathFor(user), error);
+    if (error)
+    {
+        users.erase(user);
+        return nullptr;
+    }
+
+    auto cached = users.find(user);
+    if (cached != users.end() && cached->second.modified == modified)
+        return cached->second.matcher;
+
+    cv::Mat embeddings = store.load(user);
+    if (embeddings.empty())
+        return nullptr;
+
+    auto matcher = std::make_shared<EmbeddingMatcher>(embeddings);
+    users[user] = CachedUser{.modified = modified, .matcher = matcher};
+    return matcher;
+}
+
+AuthReply AuthService::handle(const AuthRequest &request)
+{
+    TRACE_SCOPE("daemon.handle");
+    auto arrival = std::chrono::steady_clock::now();
+    if (!may_request(request))
+        return AuthReply{.message = "not allowed to authenticate " + request.user};
+
+    // Samples of other models, or a damaged store, leave the user to the next PAM module.
+    std::shared_ptr<EmbeddingMatcher> matcher;
+    try
+    {
+        matcher = enrolled(request.user);
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::warn("{}", e.what());
+        return AuthReply{.message = e.what()};
+    }
+    if (!matcher)
+        return AuthReply{.message = request.user + " is not enrolled"};
+
+    // A warm camera kept filling its buffers since the last request. Those frames
+    // may show whoever was in front of it back then, so they must never be used.
+    if (!camera)
+        camera = open_camera();
+    else
+        camera->flush();
+    last_used = std::chrono::steady_clock::now();
+
+    AuthEngine engine(AuthConfig{
+        .deadline = std::min(request.timeout, std::chrono::milliseconds(config.timeout)),
+        .max_frames = config.frames,
+        .not_before = arrival,
+        .tracking = config.tracking,
+        .quality = config.quality});
+    // A camera that stops delivering must not hold the attempt past its deadline.
+    AuthResult result = engine.authenticate([this](std::chrono::steady_clock::time_point deadline)
+                                            { return camera->nextBefore(deadline); }, *matcher);
+    last_used = std::chrono::steady_clock::now();
+
+    std::string rejections;
+    for (size_t verdict = 1; verdict < result.verdicts.size(); verdict++)
+    {
+        if (result.verdicts[verdict] > 0)
+            rejections += std::string(" ") + verdictName(static_cast<FrameVerdict>(verdict)) + "=" +
+                          std::to_string(result.verdicts[verdict]);
+    }
+
+    spdlog::info("Authentication of {}: matched={} score={:.3f} frames={}/{} stale={} rejected={}{} full_detections={} elapsed={}ms",
+                 request.user, result.matched, result.best_score,
+                 result.frames_processed, result.frames_captured, result.frames_stale, result.frames_rejected, rejections,
+                 result.tracking.full_detections, result.elapsed.count());
+
+    if (!result.error.empty())
+    {
+        // Whatever went wrong with the camera, start from a fresh session next time.
+        camera = nullptr;
+        return AuthReply{.message = result.error};
+    }
+
+    return AuthReply{
+        .status = result.matched ? AuthReply::Status::Success : AuthReply::Status::Failure,
+        .score = result.best_score};
+}
+
+/**
+ * Stop streaming once the camera has not been used for a while.
+ */
+void AuthService::idle()
+{
+    if (camera && std::chrono::steady_clock::now() - last_used > std::chrono::seconds(config.camera_idle))
+    {
+        camera = nullptr;
+        spdlog::info("Closed idle camera");
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef AUTH_SERVICE_HPP
+#define AUTH_SERVICE_HPP
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "authengine.hpp"
+#include "embeddingstore.hpp"
+#include "framesource.hpp"
+#include "matcher.hpp"
+#include "modelregistry.hpp"
+#include "protocol.hpp"
+
+/**
+ * @brief Settings of `irpamd`, read from `/etc/irpam/irpamd.conf`.
+ *
+ * The file holds one `key = value` pair per line; `#` starts a comment.
+ */
+struct DaemonConfig
+{
+    std::string socket = DEFAULT_SOCKET_PATH;
+    // A camera device path, or `replay:<path>` to play back a recording instead.
+    std::string camera;
+    // Frame interval of replayed recordings, in milliseconds.
+    int replay_interval = 33;
+    std::string fourcc = "GREY";
+    unsigned int width = 640;
+    unsigned int height = 480;
+    // UVC controls that turn on the IR emitter, see `EmitterControl`. Empty uses the default file.
+    std::string emitter_config;
+    // Skip the frames the IR emitter did not light before they reach the queue. Unset,
+    // only cameras with an emitter control in the emitter config do.
+    std::optional<bool> lit_frames;
+    int timeout = 3000;
+    int frames = 0;
+    std::string model_dir;
+    // Variants from the model manifest, by name. Empty takes the first one listed, and
+    // `auto` the fastest one on this machine that reaches `model_accuracy`.
+    std::string detector_model;
+    std::string embedding_model;
+    float model_accuracy = 1.0;
+    std::string store_dir;
+    // Seconds to keep the camera streaming after a request, so that retries are warm.
+    int camera_idle = 10;
+    // Write a Chrome trace of the recent authentications to this file, if set. The daemon
+    // runs as root, so keep it in a directory only root can write to, e.g. /var/log/irpam.
+    std::string trace;
+    // Thread budget of the models: `inference_threads`, `inference_cpus` and `inference_nice`.
+    InferenceConfig inference;
+    // Face tracking across the frames of a request: `track_template_frames` and `track_window_scale`.
+    TrackerConfig tracking;
+    // Frame quality gate in front of detection: `quality_dark_mean`, `quality_min_sharpness`
+    // and `quality_emitter_off_ratio`.
+    QualityConfig quality;
+
+    static DaemonConfig load(const std::string &path);
+};
+
+/**
+ * @brief The models named in the config, from the manifest of the model directory.
+ */
+ModelPaths choose_models(const DaemonConfig &config);
+
+/**
+ * @brief Set up the emitter controls and the models of the config, so that enrollment
+ * sees faces the same way the daemon will.
+ */
+void configure_recognition(const DaemonConfig &config);
+
+/**
+ * @brief Opens the camera and returns its stream. The camera stays open for as long
+ * as the stream is alive. Tests swap this out for a fake camera.
+ */
+using CameraOpener = std::function<std::shared_ptr<FrameStream>()>;
+
+CameraOpener camera_opener(const DaemonConfig &config);
+
+/**
+ * @brief The authentication logic of the daemon.
+ *
+ * Enrolled embeddings are cached per user and only read again when the store file
+ * changes. The camera is opened on the first request and kept streaming until it
+ * has been idle for a while.
+ */
+class AuthService
+{
+private:
+    struct CachedUser
+    {
+        std::filesystem::file_time_type modified;
+        std::shared_ptr<EmbeddingMatcher> matcher;
+    };
+
+    DaemonConfig config;
+    CameraOpener open_camera;
+    EmbeddingStore store;
+    std::map<std::string, CachedUser> users;
+    std::shared_ptr<FrameStream> camera;
+    std::chrono::steady_clock::time_point last_used;
+
+    bool may_request(const AuthRequest &request) const;
+    std::shared_ptr<EmbeddingMatcher> enrolled(const std::string &user);
+
+public:
+    AuthService(const DaemonConfig &config, CameraOpener open_camera);
+
+    AuthReply handle(const AuthRequest &request);
+    void idle();
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include <csignal>
+#include "spdlog/spdlog.h"
+
+#include "authservice.hpp"
+#include "modelregistry.hpp"
+#include "trace.hpp"
+
+static AuthServer *server = nullptr;
+
+static void handle_signal(int)
+{
+    if (server)
+        server->stop();
+}
+
+/**
+ * irpamd keeps the camera, the models and the enrolled embeddings resident, and
+ * answers authentication requests of the PAM module over a Unix socket.
+ *
+ * Usage: irpamd [config path]
+ */
+int main(int argc, char **argv)
+{
+    std::string config_path = argc > 1 ? argv[1] : "/etc/irpam/irpamd.conf";
+    DaemonConfig config = DaemonConfig::load(config_path);
+
+    if (!config.trace.empty())
+        Tracer::getInstance().enable();
+
+    try
+    {
+        configure_recognition(config);
+
+        ModelRegistry &registry = ModelRegistry::getInstance();
+        registry.preload();
+        spdlog::info("Models loaded in {:.1f}ms (detector) and {:.1f}ms (embedding)",
+                     registry.getDetectorMetrics().load_ms, registry.getEmbeddingMetrics().load_ms);
+
+        AuthService service(config, camera_opener(config));
+        AuthServer listener(
+            config.socket,
+            [&service, &config](const AuthRequest &request)
+            {
+                AuthReply reply = service.handle(request);
+                Tracer &tracer = Tracer::getInstance();
+                if (!config.trace.empty())
+                {
+                    // Diagnostics must never change the answer.
+                    try
+                    {
+                        tracer.writeChromeTrace(config.trace);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        spdlog::warn("{}", e.what());
+                    }
+                }
+                else if (Tracer::enabled())
+                {
+                    // Traced with IRPAM_TRACE but without a file: log the spans of this request.
+                    tracer.log();
+                    tracer.clear();
+                }
+                return reply;
+            },
+            [&service]()
+            { service.idle(); });
+
+        server = &listener;
+        std::signal(SIGINT, handle_signal);
+        std::signal(SIGTERM, handle_signal);
+
+        spdlog::info("Listening on {}", config.socket);
+        listener.serve();
+        server = nullptr;
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::error("{}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
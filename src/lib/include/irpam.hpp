@@ -2,7 +2,7 @@
 #define IRPAM_H
 
 #include <security/pam_modules.h>
-#include <opencv2/opencv.hpp>
+#include <security/pam_ext.h>
 
 // Exports for pam auth.
 extern "C"
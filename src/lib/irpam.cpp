@@ -1,9 +1,95 @@
 #include "include/irpam.hpp"
+#include <chrono>
+#include <string>
+#include <syslog.h>
+
+#include "protocol.hpp"
+#include "trace.hpp"
+
+/**
+ * @brief Module arguments from the PAM config line, e.g.
+ * `auth sufficient libirpam.so socket=/run/irpamd.sock timeout=3000 trace=/var/log/irpam/pam.json`.
+ * The trace file is written with the privileges of the PAM client, often root, so
+ * it belongs in a directory only root can write to.
+ *
+ * The camera, the models and the enrolled embeddings all live in `irpamd`;
+ * the module only forwards the request and maps the answer to a PAM result.
+ */
+struct ModuleOptions
+{
+    std::string socket = DEFAULT_SOCKET_PATH;
+    int timeout = 3000;
+    std::string trace;
+};
+
+static ModuleOptions parse_options(int argc, const char **argv)
+{
+    ModuleOptions options;
+    for (int i = 0; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        auto separator = arg.find('=');
+        if (separator == std::string::npos)
+            continue;
+
+        std::string key = arg.substr(0, separator);
+        std::string value = arg.substr(separator + 1);
+
+        if (key == "socket")
+            options.socket = value;
+        else if (key == "timeout")
+            options.timeout = std::stoi(value);
+        else if (key == "trace")
+            options.trace = value;
+    }
+    return options;
+}
 
 extern "C" int pam_sm_authenticate(pam_handle_t *pamh, int flags, int argc, const char **argv)
 {
-    cv::Mat sample;
-    return PAM_SUCCESS;
+    const char *user = nullptr;
+    if (pam_get_user(pamh, &user, nullptr) != PAM_SUCCESS || user == nullptr)
+        return PAM_USER_UNKNOWN;
+
+    try
+    {
+        ModuleOptions options = parse_options(argc, argv);
+        if (!options.trace.empty())
+            Tracer::getInstance().enable();
+
+        AuthReply reply;
+        {
+            TRACE_SCOPE("pam.authenticate");
+            reply = request_authentication(options.socket, user, std::chrono::milliseconds(options.timeout));
+        }
+
+        if (!options.trace.empty())
+        {
+            // A trace that cannot be written must not turn a granted login into an error.
+            try
+            {
+                Tracer::getInstance().writeChromeTrace(options.trace);
+            }
+            catch (const std::exception &e)
+            {
+                pam_syslog(pamh, LOG_WARNING, "%s", e.what());
+            }
+        }
+
+        switch (reply.status)
+        {
+        case AuthReply::Status::Success:
+            return PAM_SUCCESS;
+        case AuthReply::Status::Failure:
+            return PAM_AUTH_ERR;
+        default:
+            return PAM_AUTHINFO_UNAVAIL;
+        }
+    }
+    catch (const std::exception &)
+    {
+        return PAM_AUTHINFO_UNAVAIL;
+    }
 }
 extern "C" int pam_sm_setcred(pam_handle_t *pamh, int flags, int argc, const char **argv)
 {
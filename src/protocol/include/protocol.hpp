@@ -0,0 +1,95 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * The wire protocol between the PAM module and `irpamd` is one line each way
+ * over a local Unix socket:
+ *
+ *   request:  AUTH <user> <timeout in ms>
+ *   response: OK <score> | FAIL <score> | UNAVAILABLE <reason>
+ */
+const char *const DEFAULT_SOCKET_PATH = "/run/irpamd.sock";
+
+/**
+ * @brief An authentication request, along with the uid of the process that sent it.
+ */
+struct AuthRequest
+{
+    std::string user;
+    std::chrono::milliseconds timeout{0};
+    uid_t peer_uid = 0;
+};
+
+/**
+ * @brief The daemon's answer to an authentication request.
+ */
+struct AuthReply
+{
+    enum class Status
+    {
+        Success,
+        Failure,
+        Unavailable
+    };
+
+    Status status = Status::Unavailable;
+    float score = -1;
+    std::string message;
+};
+
+/**
+ * @brief Whether a user name can be sent in a request: at most `LOGIN_NAME_MAX - 1`
+ * bytes, with no whitespace, control characters (NUL and newlines included), `:` or
+ * `/`, not starting with `-` and not `.` or `..`. That is what shadow-utils lets
+ * through, so every account that `getpwnam()` can return for PAM passes.
+ */
+bool valid_user_name(const std::string &user);
+
+std::string format_request(const AuthRequest &request);
+bool parse_request(const std::string &line, AuthRequest &request);
+std::string format_reply(const AuthReply &reply);
+AuthReply parse_reply(const std::string &line);
+
+/**
+ * @brief Ask the daemon listening on the socket to authenticate a user.
+ * Connection problems and timeouts are reported as `Status::Unavailable`.
+ */
+AuthReply request_authentication(const std::string &socket_path, const std::string &user, std::chrono::milliseconds timeout);
+
+/**
+ * @brief Accepts connections on a Unix socket and answers one request per connection.
+ *
+ * Requests are handled one at a time, there is only one camera to go around anyway.
+ */
+class AuthServer
+{
+public:
+    using Handler = std::function<AuthReply(const AuthRequest &)>;
+    using IdleHook = std::function<void()>;
+
+private:
+    std::string socket_path;
+    Handler handler;
+    IdleHook on_idle;
+    int listen_fd = -1;
+    std::atomic<bool> running = false;
+
+    void handle(int client_fd);
+
+public:
+    AuthServer(const std::string &socket_path, Handler handler, IdleHook on_idle = {});
+    AuthServer(const AuthServer &) = delete;
+    AuthServer &operator=(const AuthServer &) = delete;
+    ~AuthServer();
+
+    void serve();
+    void stop();
+};
+
+#endif
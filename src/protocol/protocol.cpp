@@ -0,0 +1,273 @@
+#include "protocol.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Requests are tiny; anything longer than this is not a request.
+static const size_t MAX_LINE_LENGTH = 512;
+// How long the client waits for the daemon on top of the authentication timeout.
+static const std::chrono::milliseconds CLIENT_SLACK{1000};
+
+bool valid_user_name(const std::string &user)
+{
+    if (user.empty() || user.size() >= LOGIN_NAME_MAX || user.front() == '-' || user == "." || user == "..")
+        return false;
+
+    return std::none_of(user.begin(), user.end(), [](char c)
+                        {
+        auto byte = static_cast<unsigned char>(c);
+        return byte <= ' ' || byte == 0x7f || c == ':' || c == '/'; });
+}
+
+std::string format_request(const AuthRequest &request)
+{
+    return "AUTH " + request.user + " " + std::to_string(request.timeout.count()) + "\n";
+}
+
+bool parse_request(const std::string &line, AuthRequest &request)
+{
+    std::istringstream stream(line);
+    std::string command;
+    long long timeout = 0;
+    if (!(stream >> command >> request.user >> timeout) || command != "AUTH" || timeout <= 0)
+        return false;
+    // Nothing may follow the timeout, and the name must be one a system could have.
+    if (!(stream >> std::ws).eof() || !valid_user_name(request.user))
+        return false;
+
+    request.timeout = std::chrono::milliseconds(timeout);
+    return true;
+}
+
+std::string format_reply(const AuthReply &reply)
+{
+    switch (reply.status)
+    {
+    case AuthReply::Status::Success:
+        return "OK " + std::to_string(reply.score) + "\n";
+    case AuthReply::Status::Failure:
+        return "FAIL " + std::to_string(reply.score) + "\n";
+    default:
+    {
+        // The reason is free text, but it has to stay on a single line.
+        std::string message = reply.message;
+        std::replace(message.begin(), message.end(), '\n', ' ');
+        return "UNAVAILABLE " + message + "\n";
+    }
+    }
+}
+
+AuthReply parse_reply(const std::string &line)
+{
+    AuthReply reply;
+    std::istringstream stream(line);
+    std::string status;
+    stream >> status;
+
+    if (status == "OK" || status == "FAIL")
+    {
+        reply.status = status == "OK" ? AuthReply::Status::Success : AuthReply::Status::Failure;
+        if (!(stream >> reply.score))
+            return AuthReply{.message = "malformed reply"};
+        return reply;
+    }
+
+    std::getline(stream >> std::ws, reply.message);
+    if (status != "UNAVAILABLE")
+        reply.message = "malformed reply";
+    return reply;
+}
+
+static sockaddr_un socket_address(const std::string &path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path is too long: " + path);
+
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+static void set_timeouts(int fd, std::chrono::milliseconds timeout)
+{
+    timeval tv = {};
+    tv.tv_sec = timeout.count() / 1000;
+    tv.tv_usec = (timeout.count() % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static bool write_all(int fd, const std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        written += n;
+    }
+    return true;
+}
+
+static bool read_line(int fd, std::string &line)
+{
+    line.clear();
+    char c;
+    while (line.size() < MAX_LINE_LENGTH)
+    {
+        ssize_t n = recv(fd, &c, 1, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        if (c == '\n')
+            return true;
+        line.push_back(c);
+    }
+    return false;
+}
+
+AuthReply request_authentication(const std::string &socket_path, const std::string &user, std::chrono::milliseconds timeout)
+{
+    if (!valid_user_name(user))
+        return AuthReply{.message = "invalid user name"};
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return AuthReply{.message = "could not create socket: " + std::string(strerror(errno))};
+
+    AuthReply reply;
+    try
+    {
+        sockaddr_un address = socket_address(socket_path);
+        set_timeouts(fd, timeout + CLIENT_SLACK);
+
+        std::string line;
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+            reply.message = "could not connect to daemon: " + std::string(strerror(errno));
+        else if (!write_all(fd, format_request(AuthRequest{.user = user, .timeout = timeout})))
+            reply.message = "could not send request: " + std::string(strerror(errno));
+        else if (!read_line(fd, line))
+            reply.message = "no reply from daemon";
+        else
+            reply = parse_reply(line);
+    }
+    catch (const std::exception &e)
+    {
+        reply = AuthReply{.message = e.what()};
+    }
+
+    close(fd);
+    return reply;
+}
+
+/**
+ * Bind the socket. A stale socket file from a previous run is removed first.
+ * The socket is world-accessible since screen lockers run PAM as the user;
+ * the handler gets the peer uid to decide what that user may ask for.
+ */
+AuthServer::AuthServer(const std::string &socket_path, Handler handler, IdleHook on_idle)
+    : socket_path(socket_path), handler(std::move(handler)), on_idle(std::move(on_idle))
+{
+    sockaddr_un address = socket_address(socket_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        throw std::runtime_error("Could not create socket: " + std::string(strerror(errno)));
+
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+        chmod(socket_path.c_str(), 0666) < 0 ||
+        listen(listen_fd, 8) < 0)
+    {
+        std::string error = strerror(errno);
+        close(listen_fd);
+        throw std::runtime_error("Could not listen on " + socket_path + ": " + error);
+    }
+}
+
+AuthServer::~AuthServer()
+{
+    close(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+/**
+ * Serve requests until `stop()` is called. The idle hook runs roughly once a
+ * second while no requests come in.
+ */
+void AuthServer::serve()
+{
+    running = true;
+    while (running)
+    {
+        pollfd pfd = {.fd = listen_fd, .events = POLLIN, .revents = 0};
+        int ready = poll(&pfd, 1, 1000);
+        if (ready < 0 && errno != EINTR)
+            throw std::runtime_error("Could not poll socket: " + std::string(strerror(errno)));
+
+        if (ready <= 0)
+        {
+            if (on_idle)
+                on_idle();
+            continue;
+        }
+
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0)
+            continue;
+
+        handle(client_fd);
+        close(client_fd);
+    }
+}
+
+void AuthServer::stop()
+{
+    running = false;
+}
+
+void AuthServer::handle(int client_fd)
+{
+    // A client that connects and then says nothing must not hold up everyone else.
+    set_timeouts(client_fd, std::chrono::milliseconds(1000));
+
+    ucred credentials = {};
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0)
+        return;
+
+    std::string line;
+    AuthRequest request;
+    AuthReply reply;
+    if (!read_line(client_fd, line) || !parse_request(line, request))
+    {
+        reply.message = "malformed request";
+    }
+    else
+    {
+        request.peer_uid = credentials.uid;
+        try
+        {
+            reply = handler(request);
+        }
+        catch (const std::exception &e)
+        {
+            reply = AuthReply{.message = e.what()};
+        }
+    }
+
+    write_all(client_fd, format_reply(reply));
+}
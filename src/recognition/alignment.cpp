@@ -0,0 +1,58 @@
+#include "alignment.hpp"
+#include <stdexcept>
+#include "trace.hpp"
+
+/**
+ * Closed-form least squares: with both point sets centered, the best rotation and
+ * scale `[a -b; b a]` follow from the dot and cross products of the point pairs.
+ */
+cv::Matx23f similarity_transform(const std::vector<cv::Point2f> &from, const std::vector<cv::Point2f> &to)
+{
+    if (from.size() != to.size() || from.size() < 2)
+        throw std::runtime_error("A similarity transform needs two or more pairs of points");
+
+    cv::Point2f from_mean(0, 0);
+    cv::Point2f to_mean(0, 0);
+    for (size_t i = 0; i < from.size(); i++)
+    {
+        from_mean += from[i];
+        to_mean += to[i];
+    }
+    from_mean *= 1.0f / from.size();
+    to_mean *= 1.0f / to.size();
+
+    double dot = 0;
+    double cross = 0;
+    double norm = 0;
+    for (size_t i = 0; i < from.size(); i++)
+    {
+        cv::Point2f p = from[i] - from_mean;
+        cv::Point2f q = to[i] - to_mean;
+        dot += p.x * q.x + p.y * q.y;
+        cross += p.x * q.y - p.y * q.x;
+        norm += p.x * p.x + p.y * p.y;
+    }
+    if (norm == 0)
+        throw std::runtime_error("Cannot align a face whose landmarks coincide");
+
+    float a = static_cast<float>(dot / norm);
+    float b = static_cast<float>(cross / norm);
+    return cv::Matx23f(
+        a, -b, to_mean.x - (a * from_mean.x - b * from_mean.y),
+        b, a, to_mean.y - (b * from_mean.x + a * from_mean.y));
+}
+
+cv::Mat align_face(const cv::Mat &image, const std::vector<cv::Point2f> &landmarks, int width, int height)
+{
+    TRACE_SCOPE("embed.align_face");
+    std::vector<cv::Point2f> target;
+    for (const auto &point : ARCFACE_TEMPLATE)
+        target.emplace_back(point.x * width / 112.0f, point.y * height / 112.0f);
+
+    cv::Mat aligned;
+    // warpAffine runs the fixed-point bilinear remap of OpenCV, vectorized for the
+    // instruction sets the build dispatches to.
+    cv::warpAffine(image, aligned, similarity_transform(landmarks, target), cv::Size(width, height),
+                   cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    return aligned;
+}
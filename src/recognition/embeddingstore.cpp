@@ -0,0 +1,235 @@
+#include "embeddingstore.hpp"
+#include "recognition.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char STORE_MAGIC[4] = {'I', 'R', 'P', 'E'};
+static const uint32_t STORE_VERSION = 2;
+// Longer embedder names are not from a manifest.
+static const uint32_t MAX_EMBEDDER_NAME = 256;
+
+// Followed by the name of the embedder, then the embeddings.
+struct StoreHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t count;
+    uint32_t preparation;
+    uint32_t embedder_length;
+};
+
+/**
+ * Faces are aligned whenever the detector finds landmarks, which only YuNet does.
+ */
+EmbeddingOrigin EmbeddingOrigin::of(const ModelPaths &paths)
+{
+    return EmbeddingOrigin{
+        .embedder = paths.embedder.name,
+        .preparation = paths.detector.decoder == "yunet" ? FacePreparation::Aligned : FacePreparation::Cropped};
+}
+
+EmbeddingOrigin EmbeddingOrigin::current()
+{
+    return of(ModelRegistry::getInstance().getPaths());
+}
+
+std::string EmbeddingOrigin::describe() const
+{
+    return embedder + (preparation == FacePreparation::Aligned ? " on aligned faces" : " on cropped faces");
+}
+
+EmbeddingStore::EmbeddingStore(const std::string &directory, EmbeddingOrigin origin)
+    : directory(directory), origin(std::move(origin))
+{
+}
+
+const EmbeddingOrigin &EmbeddingStore::getOrigin() const
+{
+    return origin;
+}
+
+/**
+ * Enrolled users are stored in `/etc/irpam/users`. The `IRPAM_STORE_DIR`
+ * environment variable overrides this.
+ */
+std::string EmbeddingStore::defaultDirectory()
+{
+    const char *directory = std::getenv("IRPAM_STORE_DIR");
+    return directory ? directory : "/etc/irpam/users";
+}
+
+/**
+ * Get the path of the store file of a user. User names come from PAM, so
+ * anything that could escape the store directory is rejected.
+ */
+std::string EmbeddingStore::pathFor(const std::string &user) const
+{
+    if (user.empty() || user == "." || user == ".." || user.find('/') != std::string::npos)
+        throw std::runtime_error("Invalid user name: " + user);
+
+    return directory + "/" + user + ".emb";
+}
+
+bool EmbeddingStore::contains(const std::string &user) const
+{
+    return std::filesystem::exists(pathFor(user));
+}
+
+/**
+ * Load all enrolled embeddings of a user.
+ *
+ * @returns An N x EMBEDDING_WIDTH matrix, or an empty matrix if the user is not enrolled.
+ */
+cv::Mat EmbeddingStore::load(const std::string &user) const
+{
+    std::ifstream file(pathFor(user), std::ios::binary);
+    if (!file)
+        return cv::Mat();
+
+    StoreHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        throw std::runtime_error("Truncated embedding store for user: " + user);
+
+    if (std::memcmp(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0)
+        throw std::runtime_error("Unrecognized embedding store for user: " + user);
+
+    // Version 1 did not record the model, so there is no telling what its samples are.
+    if (header.version != STORE_VERSION)
+        throw std::runtime_error("Embedding store of user " + user +
+                                 " is from an older version of irpam, remove and enroll the user again");
+
+    if (header.width != EMBEDDING_WIDTH || header.embedder_length > MAX_EMBEDDER_NAME)
+        throw std::runtime_error("Embedding store of user " + user + " was created for a different model");
+
+    EmbeddingOrigin stored{.embedder = std::string(header.embedder_length, '\0'),
+                           .preparation = static_cast<FacePreparation>(header.preparation)};
+    if (!file.read(stored.embedder.data(), header.embedder_length))
+        throw std::runtime_error("Truncated embedding store for user: " + user);
+
+    if (!(stored == origin))
+        throw std::runtime_error("Embedding store of user " + user + " holds embeddings of " + stored.describe() +
+                                 ", but " + origin.describe() + " are in use, remove and enroll the user again");
+
+    // The count comes from the file, so check it against the file before allocating.
+    auto header_end = file.tellg();
+    file.seekg(0, std::ios::end);
+    uint64_t remaining = static_cast<uint64_t>(file.tellg() - header_end);
+    file.seekg(header_end);
+    if (static_cast<uint64_t>(header.count) * EMBEDDING_WIDTH * sizeof(float) > remaining)
+        throw std::runtime_error("Truncated embedding store for user: " + user);
+
+    cv::Mat embeddings(header.count, EMBEDDING_WIDTH, CV_32F);
+    if (header.count > 0 && !file.read(reinterpret_cast<char *>(embeddings.data), embeddings.total() * sizeof(float)))
+        throw std::runtime_error("Truncated embedding store for user: " + user);
+
+    return embeddings;
+}
+
+static void write_all(int fd, const char *data, size_t size, const std::string &path)
+{
+    while (size > 0)
+    {
+        ssize_t count = ::write(fd, data, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            throw std::runtime_error("Could not write embedding store: " + path + ": " + strerror(errno));
+        data += count;
+        size -= count;
+    }
+}
+
+static void sync_file(int fd, const std::string &path)
+{
+    int result = ::fsync(fd);
+    int error = errno;
+    ::close(fd);
+    if (result < 0)
+        throw std::runtime_error("Could not sync embedding store: " + path + ": " + strerror(error));
+}
+
+/**
+ * Replace all enrolled embeddings of a user. The file is written next to the
+ * old one, synced and renamed over it, and the rename is synced too, so neither
+ * a crash nor a power loss leaves a half-written or empty store.
+ */
+void EmbeddingStore::save(const std::string &user, const cv::Mat &embeddings) const
+{
+    if (!embeddings.empty() && (embeddings.cols != EMBEDDING_WIDTH || embeddings.type() != CV_32F))
+        throw std::runtime_error("Embeddings must be rows of EMBEDDING_WIDTH floats");
+    if (origin.embedder.size() > MAX_EMBEDDER_NAME)
+        throw std::runtime_error("Embedder name is too long for the embedding store: " + origin.embedder);
+
+    std::filesystem::create_directories(directory);
+
+    std::string path = pathFor(user);
+    std::string temporary = path + ".tmp";
+
+    // Embeddings are biometric data, nobody but root gets to read them.
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Could not open embedding store for writing: " + temporary + ": " + strerror(errno));
+
+    try
+    {
+        cv::Mat rows = embeddings.isContinuous() ? embeddings : embeddings.clone();
+        StoreHeader header = {.magic = {},
+                              .version = STORE_VERSION,
+                              .width = EMBEDDING_WIDTH,
+                              .count = static_cast<uint32_t>(rows.rows),
+                              .preparation = static_cast<uint32_t>(origin.preparation),
+                              .embedder_length = static_cast<uint32_t>(origin.embedder.size())};
+        std::memcpy(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+
+        write_all(fd, reinterpret_cast<const char *>(&header), sizeof(header), temporary);
+        write_all(fd, origin.embedder.data(), origin.embedder.size(), temporary);
+        write_all(fd, reinterpret_cast<const char *>(rows.data), rows.total() * sizeof(float), temporary);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    sync_file(fd, temporary);
+
+    std::filesystem::rename(temporary, path);
+
+    int directory_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0)
+        throw std::runtime_error("Could not open embedding store directory: " + directory + ": " + strerror(errno));
+    sync_file(directory_fd, directory);
+}
+
+/**
+ * Add embeddings to the samples of a user. Takes a single embedding or a
+ * N x EMBEDDING_WIDTH matrix of them.
+ */
+void EmbeddingStore::append(const std::string &user, const cv::Mat &embedding) const
+{
+    cv::Mat row = embedding.reshape(1, static_cast<int>(embedding.total() / EMBEDDING_WIDTH));
+    cv::Mat embeddings = load(user);
+    if (embeddings.empty())
+    {
+        save(user, row);
+        return;
+    }
+
+    cv::Mat combined;
+    cv::vconcat(std::vector<cv::Mat>{embeddings, row}, combined);
+    save(user, combined);
+}
+
+/**
+ * Forget all enrolled embeddings of a user.
+ */
+void EmbeddingStore::remove(const std::string &user) const
+{
+    std::filesystem::remove(pathFor(user));
+}
@@ -0,0 +1,217 @@
+#include "facedetector.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "modelregistry.hpp"
+#include "resize.hpp"
+#include "trace.hpp"
+
+static const int YUNET_STRIDES[] = {8, 16, 32};
+
+FaceDetector::FaceDetector(const ModelSpec &spec)
+    : spec(spec)
+{
+    if (spec.role != ModelRole::Detector)
+        throw std::runtime_error("Not a detection model: " + spec.name);
+}
+
+const ModelSpec &FaceDetector::getSpec() const
+{
+    return spec;
+}
+
+/**
+ * The detector for a model spec, by its `decoder`.
+ */
+std::unique_ptr<FaceDetector> FaceDetector::create(const ModelSpec &spec)
+{
+    if (spec.decoder == "yunet")
+        return std::make_unique<YuNetFaceDetector>(spec);
+    if (spec.decoder == "ssd")
+        return std::make_unique<SsdFaceDetector>(spec);
+
+    throw std::runtime_error("Unknown detection decoder: " + spec.decoder);
+}
+
+cv::Mat FaceDetector::prepare(const cv::Mat &image) const
+{
+    // The frame keeps its layout until `to_network_input()`.
+    cv::Mat resized(spec.input_height, spec.input_width, image.type());
+    resize_into(ImageView::fromMat(image), resized.data, spec.input_width, spec.input_height, resized.step[0]);
+    return spec.blobFromImages({to_network_input(resized)});
+}
+
+static float intersection_over_union(const DetectedFace &first, const DetectedFace &second)
+{
+    int width = std::min(first.x + first.w, second.x + second.w) - std::max(first.x, second.x);
+    int height = std::min(first.y + first.h, second.y + second.h) - std::max(first.y, second.y);
+    if (width <= 0 || height <= 0)
+        return 0;
+
+    float intersection = static_cast<float>(width) * height;
+    return intersection / (first.size + second.size - intersection);
+}
+
+std::vector<DetectedFace> non_max_suppression(std::vector<DetectedFace> faces, float iou_threshold, size_t max_candidates)
+{
+    // Order indices rather than the faces, which carry their landmarks along. Only the
+    // candidates get sorted.
+    std::vector<size_t> order(faces.size());
+    std::iota(order.begin(), order.end(), 0);
+    size_t candidates = max_candidates > 0 ? std::min(max_candidates, order.size()) : order.size();
+    std::partial_sort(order.begin(), order.begin() + candidates, order.end(), [&faces](size_t first, size_t second)
+                      { return faces[first].confidence > faces[second].confidence; });
+    order.resize(candidates);
+
+    std::vector<bool> suppressed(faces.size(), false);
+    std::vector<DetectedFace> kept;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (suppressed[order[i]])
+            continue;
+
+        kept.push_back(std::move(faces[order[i]]));
+        if (iou_threshold <= 0)
+            continue;
+        for (size_t j = i + 1; j < order.size(); j++)
+        {
+            if (!suppressed[order[j]] && intersection_over_union(kept.back(), faces[order[j]]) > iou_threshold)
+                suppressed[order[j]] = true;
+        }
+    }
+    return kept;
+}
+
+void keep_largest(std::vector<DetectedFace> &faces, size_t count)
+{
+    count = std::min(count, faces.size());
+    std::partial_sort(faces.begin(), faces.begin() + count, faces.end(), [](const DetectedFace &first, const DetectedFace &second)
+                      { return first.size > second.size; });
+    faces.resize(count);
+}
+
+std::vector<DetectedFace> FaceDetector::detect(const cv::Mat &image, size_t limit) const
+{
+    std::vector<DetectedFace> faces = non_max_suppression(decode(image), spec.nms_threshold);
+
+    if (limit == 0)
+        limit = spec.top_k > 0 ? spec.top_k : faces.size();
+    keep_largest(faces, limit);
+    return faces;
+}
+
+SsdFaceDetector::SsdFaceDetector(const ModelSpec &spec)
+    : FaceDetector(spec)
+{
+}
+
+std::vector<DetectedFace> SsdFaceDetector::decode(const cv::Mat &image) const
+{
+    TRACE_SCOPE("detect.ssd");
+    cv::Mat detections = ModelRegistry::getInstance().detect(prepare(image)).front();
+
+    std::vector<DetectedFace> faces;
+    for (int i = 0; i < detections.size[2]; ++i)
+    {
+        const float *detection = detections.ptr<float>(0, 0, i);
+        float confidence = detection[2];
+        if (confidence <= spec.threshold)
+            continue;
+
+        int x = static_cast<int>(detection[3] * image.cols);
+        int y = static_cast<int>(detection[4] * image.rows);
+        int endx = static_cast<int>(detection[5] * image.cols);
+        int endy = static_cast<int>(detection[6] * image.rows);
+        faces.push_back(DetectedFace{
+            .x = x,
+            .y = y,
+            .w = endx - x,
+            .h = endy - y,
+            .size = (endx - x) * (endy - y),
+            .confidence = confidence});
+    }
+    return faces;
+}
+
+YuNetFaceDetector::YuNetFaceDetector(const ModelSpec &spec)
+    : FaceDetector(spec)
+{
+    if (spec.input_width % 32 != 0 || spec.input_height % 32 != 0)
+        throw std::runtime_error("The input size of " + spec.name + " must be a multiple of 32");
+    if (spec.outputs.size() != 12)
+        throw std::runtime_error(spec.name + " needs the cls, obj, bbox and kps outputs of every stride");
+}
+
+std::vector<DetectedFace> YuNetFaceDetector::decode(const cv::Mat &image) const
+{
+    TRACE_SCOPE("detect.yunet");
+    auto outputs = ModelRegistry::getInstance().detect(prepare(image));
+
+    float scale_x = static_cast<float>(image.cols) / spec.input_width;
+    float scale_y = static_cast<float>(image.rows) / spec.input_height;
+
+    std::vector<DetectedFace> faces;
+    for (int level = 0; level < 3; level++)
+    {
+        int stride = YUNET_STRIDES[level];
+        int cols = spec.input_width / stride;
+        int rows = spec.input_height / stride;
+        const cv::Mat &cls = outputs[level];
+        const cv::Mat &obj = outputs[3 + level];
+        const cv::Mat &bbox = outputs[6 + level];
+        const cv::Mat &kps = outputs[9 + level];
+        size_t anchors = static_cast<size_t>(rows) * cols;
+        if (cls.total() < anchors || obj.total() < anchors || bbox.total() < anchors * 4 || kps.total() < anchors * 10)
+            throw std::runtime_error("Unexpected output size of " + spec.name);
+
+        // Score every anchor in one branch-free pass over the contiguous heads, which
+        // the compiler vectorizes. The score is the geometric mean of both heads, so
+        // it is compared squared and the root is only taken for the anchors that pass.
+        thread_local std::vector<float> scores;
+        scores.resize(anchors);
+        const float *cls_scores = cls.ptr<float>();
+        const float *obj_scores = obj.ptr<float>();
+        for (size_t i = 0; i < anchors; i++)
+            scores[i] = std::clamp(cls_scores[i], 0.0f, 1.0f) * std::clamp(obj_scores[i], 0.0f, 1.0f);
+
+        float min_score = spec.threshold * spec.threshold;
+        for (int row = 0; row < rows; row++)
+        {
+            for (int col = 0; col < cols; col++)
+            {
+                int i = row * cols + col;
+                // Almost every anchor is background; skip them before decoding the box.
+                if (scores[i] <= min_score)
+                    continue;
+                float score = std::sqrt(scores[i]);
+
+                const float *box = bbox.ptr<float>() + i * 4;
+                float center_x = (col + box[0]) * stride;
+                float center_y = (row + box[1]) * stride;
+                float width = std::exp(box[2]) * stride;
+                float height = std::exp(box[3]) * stride;
+
+                int x = static_cast<int>((center_x - width / 2) * scale_x);
+                int y = static_cast<int>((center_y - height / 2) * scale_y);
+                int w = static_cast<int>(width * scale_x);
+                int h = static_cast<int>(height * scale_y);
+
+                std::vector<cv::Point2f> landmarks;
+                const float *points = kps.ptr<float>() + i * 10;
+                for (int point = 0; point < 5; point++)
+                    landmarks.emplace_back((col + points[point * 2]) * stride * scale_x,
+                                           (row + points[point * 2 + 1]) * stride * scale_y);
+
+                faces.push_back(DetectedFace{
+                    .x = x,
+                    .y = y,
+                    .w = w,
+                    .h = h,
+                    .size = w * h,
+                    .confidence = score,
+                    .landmarks = std::move(landmarks)});
+            }
+        }
+    }
+    return faces;
+}
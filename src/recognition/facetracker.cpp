@@ -0,0 +1,178 @@
+#include "facetracker.hpp"
+#include <cmath>
+#include "facedetector.hpp"
+#include "modelregistry.hpp"
+#include "trace.hpp"
+
+// Width the face is scaled to for template matching. Plenty to tell a face from the
+// background, and small enough that a match costs a few microseconds.
+static const int TEMPLATE_WIDTH = 32;
+
+static cv::Mat to_grey(const cv::Mat &frame)
+{
+    cv::Mat grey = frame;
+    if (grey.depth() == CV_16U)
+        grey.convertTo(grey, CV_8U, 1.0 / 256.0);
+    if (grey.channels() == 3)
+        cv::cvtColor(grey, grey, cv::COLOR_RGB2GRAY);
+    return grey;
+}
+
+static cv::Rect box_of(const DetectedFace &face)
+{
+    return cv::Rect(face.x, face.y, face.w, face.h);
+}
+
+static DetectedFace moved(DetectedFace face, int dx, int dy)
+{
+    face.x += dx;
+    face.y += dy;
+    for (auto &point : face.landmarks)
+        point += cv::Point2f(dx, dy);
+    return face;
+}
+
+FaceTracker::FaceTracker(const TrackerConfig &config)
+    : config(config)
+{
+}
+
+void FaceTracker::reset()
+{
+    last.reset();
+    face_template = cv::Mat();
+    template_matched = 0;
+}
+
+TrackerStats FaceTracker::getStats() const
+{
+    return stats;
+}
+
+void FaceTracker::remember(const DetectedFace &face, const cv::Mat &grey)
+{
+    last = face;
+    template_matched = 0;
+    face_template = cv::Mat();
+
+    cv::Rect box = box_of(face) & cv::Rect(0, 0, grey.cols, grey.rows);
+    if (config.template_frames <= 0 || box.width < TEMPLATE_WIDTH / 2 || box.height < TEMPLATE_WIDTH / 2)
+        return;
+
+    template_scale = static_cast<double>(TEMPLATE_WIDTH) / box.width;
+    cv::resize(grey(box), face_template, cv::Size(), template_scale, template_scale, cv::INTER_AREA);
+}
+
+/**
+ * Look for the template in a window around the last face, at the scale of the
+ * template. The box moves along, but keeps its size.
+ */
+std::optional<DetectedFace> FaceTracker::followTemplate(const cv::Mat &grey)
+{
+    TRACE_SCOPE("detect.track_template");
+    cv::Rect box = box_of(last.value());
+    int margin_x = static_cast<int>(box.width * (config.window_scale - 1) / 2);
+    int margin_y = static_cast<int>(box.height * (config.window_scale - 1) / 2);
+    cv::Rect window = cv::Rect(box.x - margin_x, box.y - margin_y, box.width + 2 * margin_x, box.height + 2 * margin_y) &
+                      cv::Rect(0, 0, grey.cols, grey.rows);
+
+    cv::Mat search;
+    cv::resize(grey(window), search, cv::Size(), template_scale, template_scale, cv::INTER_AREA);
+    if (search.cols < face_template.cols || search.rows < face_template.rows)
+        return std::nullopt;
+
+    cv::Mat correlation;
+    cv::matchTemplate(search, face_template, correlation, cv::TM_CCOEFF_NORMED);
+    double best;
+    cv::Point location;
+    cv::minMaxLoc(correlation, nullptr, &best, nullptr, &location);
+    if (best < config.min_correlation)
+        return std::nullopt;
+
+    int x = window.x + static_cast<int>(std::lround(location.x / template_scale));
+    int y = window.y + static_cast<int>(std::lround(location.y / template_scale));
+    DetectedFace face = moved(last.value(), x - std::max(0, box.x), y - std::max(0, box.y));
+    face.confidence = static_cast<float>(best);
+    return face;
+}
+
+/**
+ * Run the detector on a window around the last face only, at a reduced input size.
+ */
+std::optional<DetectedFace> FaceTracker::detectInWindow(const cv::Mat &frame)
+{
+    TRACE_SCOPE("detect.track_window");
+    cv::Rect box = box_of(last.value());
+    int side = static_cast<int>(std::max(box.width, box.height) * config.window_scale);
+    cv::Rect window = cv::Rect(box.x + box.width / 2 - side / 2, box.y + box.height / 2 - side / 2, side, side) &
+                      cv::Rect(0, 0, frame.cols, frame.rows);
+    if (window.empty())
+        return std::nullopt;
+
+    // Both decoders work at any input size; YuNet wants multiples of its largest stride.
+    ModelRegistry &registry = ModelRegistry::getInstance();
+    uint64_t generation = registry.getGeneration();
+    if (!window_detector || window_generation != generation)
+    {
+        ModelSpec spec = registry.getDetector()->getSpec();
+        auto reduced = [this](int side)
+        { return std::max(32, static_cast<int>(std::ceil(side * config.window_input_scale / 32)) * 32); };
+        spec.input_width = reduced(spec.input_width);
+        spec.input_height = reduced(spec.input_height);
+
+        window_detector = FaceDetector::create(spec);
+        window_generation = generation;
+    }
+
+    auto faces = window_detector->detect(frame(window), 1);
+    if (faces.empty())
+        return std::nullopt;
+    return moved(faces.front(), window.x, window.y);
+}
+
+std::optional<DetectedFace> FaceTracker::track(const cv::Mat &frame)
+{
+    TRACE_SCOPE("detect.track");
+    cv::Mat grey = config.template_frames > 0 ? to_grey(frame) : cv::Mat();
+
+    if (last.has_value())
+    {
+        if (!face_template.empty() && template_matched < config.template_frames)
+        {
+            auto face = followTemplate(grey);
+            if (face.has_value())
+            {
+                // The template stays that of the last detection, so it does not drift.
+                template_matched++;
+                stats.template_matches++;
+                last = face;
+                return face;
+            }
+        }
+
+        auto face = detectInWindow(frame);
+        if (face.has_value())
+        {
+            stats.window_detections++;
+            remember(face.value(), grey);
+            return face;
+        }
+
+        stats.losses++;
+        reset();
+    }
+
+    auto face = detect_face(frame);
+    stats.full_detections++;
+    if (face.has_value())
+        remember(face.value(), grey);
+    return face;
+}
+
+std::optional<cv::Mat> FaceTracker::extract(const cv::Mat &frame)
+{
+    auto face = track(frame);
+    if (!face.has_value())
+        return std::nullopt;
+    return face_image(frame, face.value());
+}
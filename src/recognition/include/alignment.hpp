@@ -0,0 +1,44 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#include <array>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+
+/**
+ * @brief Where ArcFace expects the eyes, the nose tip and the mouth corners in a
+ * 112x112 crop, in the order detectors report them: the eye and mouth corner on
+ * the left of the image come first.
+ */
+const std::array<cv::Point2f, 5> ARCFACE_TEMPLATE = {
+    cv::Point2f(38.2946f, 51.6963f),
+    cv::Point2f(73.5318f, 51.5014f),
+    cv::Point2f(56.0252f, 71.7366f),
+    cv::Point2f(41.5493f, 92.3655f),
+    cv::Point2f(70.7299f, 92.2041f)};
+
+/**
+ * @brief The rotation, uniform scale and translation that maps the points onto the
+ * target points with the least squared error.
+ *
+ * @param from Points in the source image.
+ * @param to The points they should land on, as many as `from`.
+ * @return cv::Matx23f The transform, as taken by `cv::warpAffine`.
+ */
+cv::Matx23f similarity_transform(const std::vector<cv::Point2f> &from, const std::vector<cv::Point2f> &to);
+
+/**
+ * @brief Warp a face onto the ArcFace template, scaled to the given size. This
+ * takes the crop, the rotation and the resize to the embedding input in a single
+ * bilinear pass over the frame.
+ *
+ * @param image The whole frame the landmarks were found in.
+ * @param landmarks The five landmarks of the face, in the order of `ARCFACE_TEMPLATE`.
+ * @param width Width of the aligned face.
+ * @param height Height of the aligned face.
+ * @return cv::Mat The aligned face, in the layout of the frame.
+ */
+cv::Mat align_face(const cv::Mat &image, const std::vector<cv::Point2f> &landmarks, int width, int height);
+
+#endif
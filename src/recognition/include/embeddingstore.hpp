@@ -0,0 +1,69 @@
+#ifndef EMBEDDING_STORE_H
+#define EMBEDDING_STORE_H
+
+#include <cstdint>
+#include <string>
+
+#include "opencv2/opencv.hpp"
+#include "modelregistry.hpp"
+
+/**
+ * @brief How faces are cut out of the frame before they are embedded.
+ */
+enum class FacePreparation : uint32_t
+{
+    // The box of the detector, resized to the embedder input.
+    Cropped,
+    // Warped onto the ArcFace template by the landmarks of the detector.
+    Aligned
+};
+
+/**
+ * @brief The model that made a set of embeddings, and how its faces were prepared.
+ * Embeddings of different origins live in different spaces; comparing them gives
+ * scores that mean nothing.
+ */
+struct EmbeddingOrigin
+{
+    std::string embedder;
+    FacePreparation preparation = FacePreparation::Cropped;
+
+    static EmbeddingOrigin of(const ModelPaths &paths);
+    // The origin of the embeddings the `ModelRegistry` makes right now.
+    static EmbeddingOrigin current();
+    std::string describe() const;
+
+    bool operator==(const EmbeddingOrigin &other) const = default;
+};
+
+/**
+ * @brief On-disk store of enrolled face embeddings, one file per user.
+ *
+ * Each file holds a small header, with the `EmbeddingOrigin` of the samples,
+ * followed by the raw `EMBEDDING_WIDTH`-float embeddings of every enrolled sample
+ * of the user. Embeddings are loaded as a single N x EMBEDDING_WIDTH `CV_32F`
+ * matrix, one sample per row. A store only reads and writes files of its own
+ * origin; samples of another model have to be enrolled again.
+ */
+class EmbeddingStore
+{
+private:
+    std::string directory;
+    EmbeddingOrigin origin;
+
+public:
+    explicit EmbeddingStore(const std::string &directory = defaultDirectory(),
+                            EmbeddingOrigin origin = EmbeddingOrigin::current());
+
+    static std::string defaultDirectory();
+    std::string pathFor(const std::string &user) const;
+    const EmbeddingOrigin &getOrigin() const;
+
+    bool contains(const std::string &user) const;
+    cv::Mat load(const std::string &user) const;
+    void save(const std::string &user, const cv::Mat &embeddings) const;
+    void append(const std::string &user, const cv::Mat &embedding) const;
+    void remove(const std::string &user) const;
+};
+
+#endif
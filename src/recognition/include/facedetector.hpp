@@ -0,0 +1,112 @@
+#ifndef FACE_DETECTOR_H
+#define FACE_DETECTOR_H
+
+#include <memory>
+#include <vector>
+
+#include "modelmanifest.hpp"
+#include "recognition.hpp"
+
+/**
+ * @brief The detection stage: finds the faces in a frame with the detector model of
+ * the `ModelRegistry`.
+ *
+ * Detection networks differ in how their outputs are laid out, so each family gets
+ * a subclass, picked by the `decoder` of the model spec.
+ */
+class FaceDetector
+{
+protected:
+    ModelSpec spec;
+
+    explicit FaceDetector(const ModelSpec &spec);
+
+    /**
+     * Resize the image straight to the network input in a single step, and turn it
+     * into the input blob. The image is stretched, not padded, when its aspect ratio
+     * differs from that of the input; the decoders scale the boxes back per axis.
+     */
+    cv::Mat prepare(const cv::Mat &image) const;
+
+    /**
+     * Run the network and read the detections that reach the threshold of the model
+     * from its outputs, in pixel coordinates of the image.
+     */
+    virtual std::vector<DetectedFace> decode(const cv::Mat &image) const = 0;
+
+public:
+    virtual ~FaceDetector() = default;
+
+    /**
+     * The faces in the image, after non-maximum suppression, largest first.
+     *
+     * @param limit The most faces to return. Zero returns the `top_k` of the model.
+     * Only the `NMS_CANDIDATES` most confident detections go through suppression, and
+     * only the faces that are returned get ordered by size.
+     */
+    std::vector<DetectedFace> detect(const cv::Mat &image, size_t limit = 0) const;
+
+    const ModelSpec &getSpec() const;
+
+    static std::unique_ptr<FaceDetector> create(const ModelSpec &spec);
+};
+
+// Detections that take part in non-maximum suppression, the most confident first. A
+// few faces in front of the camera are a few clusters of boxes each, well below this.
+const size_t NMS_CANDIDATES = 64;
+
+/**
+ * @brief Greedy non-maximum suppression: keeps the most confident detection of every
+ * group of overlapping ones.
+ *
+ * The candidates are picked with a partial sort, so suppression costs at most
+ * `max_candidates` squared comparisons however many detections come in.
+ *
+ * @param faces The detections, in any order.
+ * @param iou_threshold Detections overlapping a kept one by more than this IoU are
+ * dropped. Zero or less keeps every candidate.
+ * @param max_candidates Only this many of the most confident detections are
+ * considered. Zero considers all of them.
+ * @return std::vector<DetectedFace> The kept detections, most confident first.
+ */
+std::vector<DetectedFace> non_max_suppression(std::vector<DetectedFace> faces, float iou_threshold,
+                                              size_t max_candidates = NMS_CANDIDATES);
+
+/**
+ * @brief Move the `count` largest faces to the front, largest first, and drop the rest.
+ */
+void keep_largest(std::vector<DetectedFace> &faces, size_t count);
+
+/**
+ * @brief The ResNet-10 SSD that ships with irpam. It has a single output of shape
+ * [1, 1, N, 7], one row per detection, with the box normalized to the input.
+ */
+class SsdFaceDetector : public FaceDetector
+{
+public:
+    explicit SsdFaceDetector(const ModelSpec &spec);
+
+protected:
+    std::vector<DetectedFace> decode(const cv::Mat &image) const override;
+};
+
+/**
+ * @brief Anchor-free detectors in the style of YuNet, with classification, objectness,
+ * box and landmark heads at strides 8, 16 and 32.
+ *
+ * These are a fraction of the size of the SSD and are meant to run at a low input
+ * size like 160x128, which is plenty for an IR camera with a single close face. They
+ * also find the five landmarks `align_face()` needs. The input sides must be
+ * multiples of 32, and the spec lists the outputs in the order cls, obj, bbox, kps,
+ * each for strides 8, 16 and 32.
+ */
+class YuNetFaceDetector : public FaceDetector
+{
+public:
+    explicit YuNetFaceDetector(const ModelSpec &spec);
+
+protected:
+    std::vector<DetectedFace> decode(const cv::Mat &image) const override;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef FACE_TRACKER_H
+#define FACE_TRACKER_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include "opencv2/opencv.hpp"
+#include "recognition.hpp"
+
+class FaceDetector;
+
+/**
+ * @brief Knobs of the `FaceTracker`.
+ */
+struct TrackerConfig
+{
+    // Side of the search window around the last face, relative to the face.
+    float window_scale = 2.0;
+    // Input of the detector for a search window, relative to the model input. The
+    // face fills most of the window, so it needs far fewer pixels than a whole frame.
+    float window_input_scale = 0.5;
+    // Frames to follow the last face by template matching, without running the
+    // detector at all. Zero runs the detector on every frame.
+    int template_frames = 2;
+    // Below this normalized correlation, the template has lost the face.
+    float min_correlation = 0.85;
+};
+
+/**
+ * @brief What the tracker did for the frames it has seen.
+ */
+struct TrackerStats
+{
+    int full_detections = 0;
+    int window_detections = 0;
+    int template_matches = 0;
+    // Times the face was lost by the window or the template, and looked for again.
+    int losses = 0;
+};
+
+/**
+ * @brief Follows a face across the frames of a stream, so that detection does not
+ * have to look at the whole frame every time.
+ *
+ * At a login screen the face barely moves between frames. After the first full
+ * frame detection, the tracker follows the face with a cheap template match for a
+ * few frames, then confirms it by running the detector on a window around its
+ * last position, at a reduced input size. Whenever the face is lost, the next
+ * frame goes through full frame detection again.
+ *
+ * A tracker belongs to a single stream and is not thread safe.
+ */
+class FaceTracker
+{
+private:
+    TrackerConfig config;
+    std::optional<DetectedFace> last;
+    // The last detected face, grey and downscaled for template matching.
+    cv::Mat face_template;
+    double template_scale = 1;
+    int template_matched = 0;
+    // The detector of the registry at the reduced input size, and the registry
+    // generation it was made for.
+    std::shared_ptr<const FaceDetector> window_detector;
+    uint64_t window_generation = 0;
+    TrackerStats stats;
+
+    std::optional<DetectedFace> followTemplate(const cv::Mat &grey);
+    std::optional<DetectedFace> detectInWindow(const cv::Mat &frame);
+    void remember(const DetectedFace &face, const cv::Mat &grey);
+
+public:
+    explicit FaceTracker(const TrackerConfig &config = {});
+
+    /**
+     * Find the face in the next frame of the stream.
+     */
+    std::optional<DetectedFace> track(const cv::Mat &frame);
+
+    /**
+     * Like `extract_face()`, for the next frame of the stream.
+     */
+    std::optional<cv::Mat> extract(const cv::Mat &frame);
+
+    /**
+     * Forget the face, so the next frame goes through full frame detection.
+     */
+    void reset();
+
+    TrackerStats getStats() const;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include <cstddef>
+#include <memory>
+
+#include "opencv2/opencv.hpp"
+
+/**
+ * @brief The instruction set used to score embeddings.
+ */
+enum class MatcherKernel
+{
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+/**
+ * @brief Result of matching a probe against all enrolled embeddings.
+ */
+struct MatchResult
+{
+    float score;
+    int index;
+};
+
+/**
+ * @brief Many-to-one cosine similarity matcher.
+ *
+ * Enrolled embeddings are normalized once and stored dimension-major in a single
+ * 64-byte aligned buffer: component d of every enrolled row sits next to the
+ * others, padded to a multiple of 16 rows. Scoring a probe broadcasts one of its
+ * components at a time and multiplies it into 16 rows per FMA, so all scores come
+ * out of one pass without a horizontal sum per row. The kernel is picked at runtime
+ * from the best instruction set the CPU supports, falling back to scalar code.
+ * Asking for a kernel the CPU cannot run throws.
+ */
+class EmbeddingMatcher
+{
+private:
+    struct AlignedDeleter
+    {
+        void operator()(float *data) const;
+    };
+
+    // `width` columns of `capacity` floats each; row r of dimension d is at d * capacity + r.
+    std::unique_ptr<float[], AlignedDeleter> data;
+    size_t width;
+    size_t count = 0;
+    size_t capacity = 0;
+    MatcherKernel kernel;
+
+    void reserve(size_t rows);
+
+public:
+    explicit EmbeddingMatcher(size_t width, MatcherKernel kernel = bestKernel());
+    explicit EmbeddingMatcher(const cv::Mat &embeddings, MatcherKernel kernel = bestKernel());
+
+    static MatcherKernel bestKernel();
+
+    void add(const cv::Mat &embedding);
+    size_t size() const;
+    MatcherKernel getKernel() const;
+
+    MatchResult best(const cv::Mat &probe) const;
+};
+
+#endif
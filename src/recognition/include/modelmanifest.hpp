@@ -0,0 +1,100 @@
+#ifndef MODEL_MANIFEST_H
+#define MODEL_MANIFEST_H
+
+#include <string>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+#include "opencv2/dnn.hpp"
+
+enum class ModelRole
+{
+    Detector,
+    Embedder
+};
+
+/**
+ * @brief One model variant: where it lives on disk and how to feed it.
+ */
+struct ModelSpec
+{
+    std::string name;
+    ModelRole role = ModelRole::Detector;
+    // The network, and for Caffe models the prototxt that goes with it.
+    std::string weights;
+    std::string config;
+    int input_width = 0;
+    int input_height = 0;
+    // Input normalization, as in `cv::dnn::blobFromImage`: (pixel - mean) * scale.
+    double scale = 1.0;
+    cv::Scalar mean = cv::Scalar();
+    bool swap_rb = false;
+    // The layers to read the results from. Empty reads the last layer.
+    std::vector<std::string> outputs;
+    // How detectors turn their outputs into faces: `ssd` or `yunet`, see `FaceDetector`.
+    std::string decoder = "ssd";
+    // Minimum confidence of a detection.
+    float threshold = 0.8;
+    // Detections that overlap a more confident one by more than this IoU are dropped.
+    // Zero turns non-maximum suppression off.
+    float nms_threshold = 0.3;
+    // Most faces reported per frame, largest first. Zero reports all of them.
+    int top_k = 0;
+    // fp32, fp16 or int8. Informational, the file decides what actually runs.
+    std::string precision = "fp32";
+    // Accuracy relative to the reference model of the role, which has 1.0. This is
+    // measured offline, on a labelled set, and only read from the manifest.
+    float accuracy = 1.0;
+    // Length of the embedding vector. Detectors leave it at zero.
+    int embedding_width = 0;
+
+    cv::Mat blobFromImages(const std::vector<cv::Mat> &images) const;
+};
+
+/**
+ * @brief Timing of a model variant on this machine, as measured by `select_fastest()`.
+ */
+struct ModelTiming
+{
+    std::string name;
+    double median_ms;
+};
+
+/**
+ * @brief The model variants that are installed, read from `manifest.txt` in the model
+ * directory.
+ *
+ * The manifest has one `[name]` section per variant, followed by `key = value` lines
+ * for the fields of `ModelSpec` (`input` is given as `WIDTHxHEIGHT`, `mean` as up to
+ * three comma separated values, `output` as a comma separated list of layers).
+ * Relative paths are relative to the manifest. Without a manifest, the directory is
+ * expected to hold the models that ship with irpam.
+ */
+struct ModelManifest
+{
+    std::vector<ModelSpec> models;
+
+    static ModelManifest load(const std::string &path);
+    static ModelManifest builtin(const std::string &directory);
+    static ModelManifest fromDirectory(const std::string &directory);
+    static std::string defaultDirectory();
+
+    std::vector<ModelSpec> variants(ModelRole role) const;
+    ModelSpec choose(ModelRole role, const std::string &name, float accuracy_target) const;
+};
+
+/**
+ * @brief Time every variant of a role that reaches the accuracy target on this CPU,
+ * and return the fastest one.
+ *
+ * Each variant is loaded and run a few times on a synthetic input of its size; the
+ * median forward pass decides. Variants whose files are missing are skipped, and so
+ * are embedders whose embeddings do not fit the enrolled ones.
+ *
+ * @param timings If not null, receives the timing of every variant that was run.
+ * @throws std::runtime_error if no variant qualifies.
+ */
+ModelSpec select_fastest(const ModelManifest &manifest, ModelRole role, float accuracy_target,
+                         int runs = 5, std::vector<ModelTiming> *timings = nullptr);
+
+#endif
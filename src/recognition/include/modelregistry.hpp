@@ -0,0 +1,164 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+#include "opencv2/dnn.hpp"
+#include "modelmanifest.hpp"
+
+class FaceDetector;
+
+/**
+ * @brief The detection and embedding models in use, and how to feed them.
+ */
+struct ModelPaths
+{
+    ModelSpec detector;
+    ModelSpec embedder;
+
+    static ModelPaths fromDirectory(const std::string &directory);
+    static ModelPaths defaults();
+};
+
+/**
+ * @brief How many CPUs inference may use, and at which priority.
+ *
+ * Face authentication runs at login, next to a desktop session that is starting
+ * up, so the daemon can be kept off some cores or niced down.
+ */
+struct InferenceConfig
+{
+    // Threads OpenCV uses for a forward pass. Zero keeps OpenCV's default.
+    int threads = 0;
+    // CPUs the inference threads are pinned to. Empty leaves the affinity alone.
+    std::vector<int> cpus;
+    // Nice value of the inference threads. Zero leaves the priority alone; without
+    // privileges it can only be raised.
+    int nice = 0;
+
+    static std::vector<int> parseCpuList(const std::string &list);
+};
+
+/**
+ * @brief The thread forward passes run on.
+ *
+ * It is pinned and niced by the `InferenceConfig` it is started with, so the threads
+ * that ask for inference, like the poll loop of the daemon or a capture thread, keep
+ * their own affinity and priority. A new config takes a new thread, which starts
+ * from the affinity and priority of the thread that creates it.
+ */
+class InferenceThread
+{
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    std::thread thread;
+
+    void loop();
+
+public:
+    explicit InferenceThread(const InferenceConfig &config);
+    ~InferenceThread();
+
+    InferenceThread(const InferenceThread &) = delete;
+    InferenceThread &operator=(const InferenceThread &) = delete;
+
+    /**
+     * Run a task on the thread and wait for it. Exceptions of the task are rethrown.
+     */
+    void call(const std::function<void()> &task);
+};
+
+/**
+ * @brief Timings for a single model. Load time is only set once the model is loaded.
+ */
+struct ModelMetrics
+{
+    double load_ms = 0;
+    uint64_t inferences = 0;
+    double total_inference_ms = 0;
+    double last_inference_ms = 0;
+};
+
+/**
+ * @brief Process-wide registry of the DNN models. Each model is read from disk once,
+ * on first use or on `preload()`, and the network is kept warm for the lifetime of the
+ * program. This is a singleton object, like the `CameraManager`.
+ *
+ * Forward passes run one at a time on an `InferenceThread`, since `cv::dnn::Net` is
+ * not safe to run from multiple threads at once. A forward pass itself fans out over
+ * the threads allowed by the `InferenceConfig`.
+ */
+class ModelRegistry
+{
+private:
+    struct Model
+    {
+        cv::dnn::Net net;
+        // The layers to read, from the spec the network was loaded from.
+        std::vector<std::string> outputs;
+        bool loaded = false;
+        ModelMetrics metrics;
+        mutable std::mutex lock;
+    };
+
+    ModelPaths paths;
+    // The decoder of the detector in `paths`, made on first use.
+    mutable std::shared_ptr<const FaceDetector> face_detector;
+    // The embedder of `paths`, shared so that callers need not copy it.
+    std::shared_ptr<const ModelSpec> embedder_spec;
+    // Bumped on every `configure()`, so callers can tell that what they built from
+    // the old paths is stale.
+    std::atomic<uint64_t> generation = 1;
+    Model detector;
+    Model embedder;
+    mutable std::mutex paths_lock;
+    InferenceConfig inference;
+    // Started on the first forward pass after a change of the inference config.
+    std::unique_ptr<InferenceThread> inference_thread;
+    std::mutex inference_lock;
+    ModelRegistry();
+
+    InferenceThread &getInferenceThread();
+    void load(Model &model, bool is_detector);
+    std::vector<cv::Mat> run(Model &model, bool is_detector, const cv::Mat &blob);
+
+public:
+    ModelRegistry(const ModelRegistry &) = delete;
+    ModelRegistry &operator=(const ModelRegistry &) = delete;
+
+    static ModelRegistry &getInstance()
+    {
+        static ModelRegistry instance;
+        return instance;
+    }
+
+    void configure(const ModelPaths &paths);
+    ModelPaths getPaths() const;
+    std::shared_ptr<const FaceDetector> getDetector() const;
+    std::shared_ptr<const ModelSpec> getEmbedder() const;
+    uint64_t getGeneration() const;
+    void configureInference(const InferenceConfig &config);
+    InferenceConfig getInferenceConfig() const;
+    void preload();
+
+    std::vector<cv::Mat> detect(const cv::Mat &blob);
+    cv::Mat embed(const cv::Mat &blob);
+
+    ModelMetrics getDetectorMetrics() const;
+    ModelMetrics getEmbeddingMetrics() const;
+};
+
+#endif
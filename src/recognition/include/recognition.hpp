@@ -10,10 +10,10 @@
 
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include <optional>
+#include <vector>
 
-// We need to split these out from the def 
-// because we have not settled on a single model yet,
-// and these are the params that keep changing between models.
+// Input sizes of the models that ship with irpam. Other variants describe their
+// own inputs in the model manifest.
 const int DETECTION_NET_WIDTH = 300;
 const int EMBEDDING_NET_WIDTH = 112;
 const int EMBEDDING_WIDTH = 512;
@@ -35,10 +35,60 @@ struct DetectedFace
     int h;
     int size;
     float confidence;
+    // The eyes, nose tip and mouth corners, in the order of `ARCFACE_TEMPLATE`. Empty
+    // if the detector does not find landmarks.
+    std::vector<cv::Point2f> landmarks;
 };
 
 /**
- * @brief Extract a face (if exists) from the input image.
+ * @brief Turn a prepared image into the 3-channel 8-bit input the networks expect.
+ * 
+ * @param image A grey, 16-bit grey or BGR image.
+ * @return cv::Mat The image as BGR, or the image itself if it already is.
+ */
+cv::Mat to_network_input(const cv::Mat &image);
+
+/**
+ * @brief Find all faces in the input image, with the detector configured in the
+ * `ModelRegistry`, see `FaceDetector`. Overlapping detections are merged.
+ * 
+ * @param input_image The input image.
+ * @return std::vector<DetectedFace> The faces, largest first, at most the `top_k`
+ * of the detection model.
+ */
+std::vector<DetectedFace> detect_faces(const cv::Mat &input_image);
+
+/**
+ * @brief Find the largest face in the input image, with the detector configured in
+ * the `ModelRegistry`, see `FaceDetector`.
+ * 
+ * @param input_image The input image.
+ * @return std::optional<DetectedFace> The face if found.
+ */
+std::optional<DetectedFace> detect_face(const cv::Mat &input_image);
+
+/**
+ * @brief Cut the bounding box of a face out of the image.
+ * 
+ * @param input_image The image the face was found in.
+ * @param face The face.
+ * @return cv::Mat A copy of the box, clipped to the image.
+ */
+cv::Mat crop_face(const cv::Mat &input_image, const DetectedFace &face);
+
+/**
+ * @brief The image of a face that goes into `face_embedding()`. If the detector
+ * found landmarks, the face is aligned to the embedding input with `align_face()`;
+ * otherwise this is the crop of its bounding box.
+ * 
+ * @param input_image The image the face was found in.
+ * @param face The face.
+ * @return cv::Mat The face image.
+ */
+cv::Mat face_image(const cv::Mat &input_image, const DetectedFace &face);
+
+/**
+ * @brief Extract a face (if exists) from the input image, see `face_image()`.
  * 
  * @param input_image The input image.
  * @return std::optional<cv::Mat> The face if found.
@@ -53,6 +103,46 @@ std::optional<cv::Mat> extract_face(const cv::Mat &input_image);
  */
 cv::Mat get_embedding(const cv::Mat &image);
 
+/**
+ * @brief Compute the embedding of a face crop. The crop is resized and normalized
+ * for the embedding network internally.
+ * 
+ * @param face The face, as returned by `extract_face`.
+ * @return cv::Mat The embedding as a 1 x EMBEDDING_WIDTH row.
+ */
+cv::Mat face_embedding(const cv::Mat &face);
+
+/**
+ * @brief Compute the embeddings of several face crops with a single forward pass.
+ * The crops are stacked into one NCHW blob, so embedding a handful of frames costs
+ * close to one inference. If the network cannot take a batch, this falls back to
+ * one forward pass per face.
+ * 
+ * @param faces The faces, as returned by `extract_face`.
+ * @return cv::Mat The embeddings as a N x EMBEDDING_WIDTH matrix, one row per face.
+ */
+cv::Mat face_embeddings(const std::vector<cv::Mat> &faces);
+
+/**
+ * @brief Best cosine similarity between an embedding and a set of enrolled embeddings.
+ * Callers that score many probes against the same set should keep an `EmbeddingMatcher`
+ * around instead.
+ * 
+ * @param embedding The embedding of the live face.
+ * @param enrolled The enrolled embeddings, one per row.
+ * @return float The highest similarity, or -1 if nothing is enrolled.
+ */
+float best_similarity(const cv::Mat &embedding, const cv::Mat &enrolled);
+
+/**
+ * @brief Check if an embedding matches any of the enrolled embeddings.
+ * 
+ * @param embedding The embedding of the live face.
+ * @param enrolled The enrolled embeddings, one per row.
+ * @return true If the best similarity reaches the threshold.
+ */
+bool matches_enrolled(const cv::Mat &embedding, const cv::Mat &enrolled);
+
 /**
  * @brief Compare two images and return if they are similar. This computes the 
  * embeddings internally and compares the cosine similarity.
@@ -0,0 +1,247 @@
+#include "matcher.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATCHER_X86 1
+#endif
+
+static const size_t MATCHER_ALIGNMENT = 64;
+static const size_t MATCHER_LANES = MATCHER_ALIGNMENT / sizeof(float);
+
+// Scores `rows` enrolled rows, a multiple of MATCHER_LANES, against a probe.
+using ScoreKernel = void (*)(const float *data, size_t capacity, size_t width, const float *probe, size_t rows,
+                             float *scores);
+
+static float dot_scalar(const float *a, const float *b, size_t n)
+{
+    float sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void score_scalar(const float *data, size_t capacity, size_t width, const float *probe, size_t rows,
+                         float *scores)
+{
+    std::memset(scores, 0, rows * sizeof(float));
+    for (size_t d = 0; d < width; d++)
+    {
+        const float *column = data + d * capacity;
+        for (size_t r = 0; r < rows; r++)
+            scores[r] += probe[d] * column[r];
+    }
+}
+
+#ifdef MATCHER_X86
+// Columns start 64-byte aligned and hold a multiple of 16 rows, so neither kernel
+// needs a tail loop or unaligned loads.
+__attribute__((target("avx2,fma"))) static void score_avx2(const float *data, size_t capacity, size_t width,
+                                                           const float *probe, size_t rows, float *scores)
+{
+    for (size_t r = 0; r < rows; r += 16)
+    {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        for (size_t d = 0; d < width; d++)
+        {
+            const float *column = data + d * capacity + r;
+            __m256 component = _mm256_broadcast_ss(probe + d);
+            acc0 = _mm256_fmadd_ps(component, _mm256_load_ps(column), acc0);
+            acc1 = _mm256_fmadd_ps(component, _mm256_load_ps(column + 8), acc1);
+        }
+        _mm256_store_ps(scores + r, acc0);
+        _mm256_store_ps(scores + r + 8, acc1);
+    }
+}
+
+__attribute__((target("avx512f"))) static void score_avx512(const float *data, size_t capacity, size_t width,
+                                                            const float *probe, size_t rows, float *scores)
+{
+    for (size_t r = 0; r < rows; r += 16)
+    {
+        // Two chains of FMAs over alternating components hide the FMA latency.
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        size_t d = 0;
+        for (; d + 2 <= width; d += 2)
+        {
+            acc0 = _mm512_fmadd_ps(_mm512_set1_ps(probe[d]), _mm512_load_ps(data + d * capacity + r), acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_set1_ps(probe[d + 1]), _mm512_load_ps(data + (d + 1) * capacity + r), acc1);
+        }
+        if (d < width)
+            acc0 = _mm512_fmadd_ps(_mm512_set1_ps(probe[d]), _mm512_load_ps(data + d * capacity + r), acc0);
+        _mm512_store_ps(scores + r, _mm512_add_ps(acc0, acc1));
+    }
+}
+#endif
+
+static ScoreKernel kernel_for(MatcherKernel kernel)
+{
+#ifdef MATCHER_X86
+    switch (kernel)
+    {
+    case MatcherKernel::AVX512:
+        return score_avx512;
+    case MatcherKernel::AVX2:
+        return score_avx2;
+    default:
+        break;
+    }
+#endif
+    return score_scalar;
+}
+
+/**
+ * Pick the widest kernel the CPU can run.
+ */
+MatcherKernel EmbeddingMatcher::bestKernel()
+{
+#ifdef MATCHER_X86
+    if (__builtin_cpu_supports("avx512f"))
+        return MatcherKernel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return MatcherKernel::AVX2;
+#endif
+    return MatcherKernel::Scalar;
+}
+
+void EmbeddingMatcher::AlignedDeleter::operator()(float *data) const
+{
+    std::free(data);
+}
+
+EmbeddingMatcher::EmbeddingMatcher(size_t width, MatcherKernel kernel)
+    : width(width), kernel(kernel)
+{
+    if (kernel > bestKernel())
+        throw std::runtime_error("Matcher kernel is not supported on this CPU");
+}
+
+/**
+ * Build a matcher over a matrix of embeddings, one per row.
+ */
+EmbeddingMatcher::EmbeddingMatcher(const cv::Mat &embeddings, MatcherKernel kernel)
+    : EmbeddingMatcher(static_cast<size_t>(embeddings.cols), kernel)
+{
+    reserve(embeddings.rows);
+    for (int i = 0; i < embeddings.rows; i++)
+        add(embeddings.row(i));
+}
+
+/**
+ * Make room for at least `rows` embeddings. Every column grows, so the enrolled
+ * rows are copied over column by column.
+ */
+void EmbeddingMatcher::reserve(size_t rows)
+{
+    if (rows <= capacity)
+        return;
+
+    size_t grown_capacity = (rows + MATCHER_LANES - 1) / MATCHER_LANES * MATCHER_LANES;
+    size_t bytes = std::max<size_t>(width, 1) * grown_capacity * sizeof(float);
+    auto grown = static_cast<float *>(std::aligned_alloc(MATCHER_ALIGNMENT, bytes));
+    if (!grown)
+        throw std::bad_alloc();
+
+    std::memset(grown, 0, bytes);
+    for (size_t d = 0; count > 0 && d < width; d++)
+        std::memcpy(grown + d * grown_capacity, data.get() + d * capacity, count * sizeof(float));
+
+    data.reset(grown);
+    capacity = grown_capacity;
+}
+
+/**
+ * Add an embedding to the matcher. It is normalized on the way in, so
+ * scoring only needs a dot product.
+ */
+void EmbeddingMatcher::add(const cv::Mat &embedding)
+{
+    if (embedding.total() != width || embedding.type() != CV_32F)
+        throw std::runtime_error("Embedding does not match the width of the matcher");
+
+    if (count == capacity)
+        reserve(std::max<size_t>(MATCHER_LANES, capacity * 2));
+
+    cv::Mat row = embedding.isContinuous() ? embedding : embedding.clone();
+    auto values = reinterpret_cast<const float *>(row.data);
+    float norm = std::sqrt(dot_scalar(values, values, width));
+    float scale = norm > 0 ? 1 / norm : 1;
+    for (size_t d = 0; d < width; d++)
+        data[d * capacity + count] = values[d] * scale;
+    count++;
+}
+
+size_t EmbeddingMatcher::size() const
+{
+    return count;
+}
+
+MatcherKernel EmbeddingMatcher::getKernel() const
+{
+    return kernel;
+}
+
+/**
+ * Score a probe against every enrolled embedding.
+ *
+ * @returns The highest cosine similarity and the row it belongs to, or a score
+ * of -1 and an index of -1 if nothing is enrolled. A probe of all zeros scores
+ * 0 against every row.
+ */
+MatchResult EmbeddingMatcher::best(const cv::Mat &probe) const
+{
+    if (probe.total() != width || probe.type() != CV_32F)
+        throw std::runtime_error("Probe does not match the width of the matcher");
+
+    if (count == 0)
+        return {.score = -1, .index = -1};
+
+    // Scores of the padding rows are computed too, and ignored.
+    size_t rows = (count + MATCHER_LANES - 1) / MATCHER_LANES * MATCHER_LANES;
+    size_t needed = width + rows;
+    alignas(MATCHER_ALIGNMENT) float stack_buffer[1024];
+    std::unique_ptr<float[], AlignedDeleter> heap_buffer;
+    float *scores = stack_buffer;
+    if (needed > 1024)
+    {
+        size_t bytes = (needed * sizeof(float) + MATCHER_ALIGNMENT - 1) / MATCHER_ALIGNMENT * MATCHER_ALIGNMENT;
+        heap_buffer.reset(static_cast<float *>(std::aligned_alloc(MATCHER_ALIGNMENT, bytes)));
+        if (!heap_buffer)
+            throw std::bad_alloc();
+        scores = heap_buffer.get();
+    }
+    // The probe follows the scores, so that they stay aligned.
+    float *normalized = scores + rows;
+
+    cv::Mat row = probe.isContinuous() ? probe : probe.clone();
+    std::memcpy(normalized, row.data, width * sizeof(float));
+
+    float norm = std::sqrt(dot_scalar(normalized, normalized, width));
+    if (norm > 0)
+    {
+        for (size_t i = 0; i < width; i++)
+            normalized[i] /= norm;
+    }
+
+    kernel_for(kernel)(data.get(), capacity, width, normalized, rows, scores);
+
+    // Start below every score, so some row is returned even if all of them are
+    // -1 or NaN.
+    MatchResult result = {.score = -std::numeric_limits<float>::infinity(), .index = 0};
+    for (size_t i = 0; i < count; i++)
+    {
+        if (scores[i] > result.score)
+        {
+            result.score = scores[i];
+            result.index = static_cast<int>(i);
+        }
+    }
+    return result;
+}
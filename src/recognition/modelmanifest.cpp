@@ -0,0 +1,286 @@
+#include "modelmanifest.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "recognition.hpp"
+#include "trace.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static std::string trim(const std::string &value)
+{
+    auto begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return "";
+    auto end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+static const char *role_name(ModelRole role)
+{
+    return role == ModelRole::Detector ? "detector" : "embedder";
+}
+
+/**
+ * Turn prepared images into the input blob of the model.
+ */
+cv::Mat ModelSpec::blobFromImages(const std::vector<cv::Mat> &images) const
+{
+    return cv::dnn::blobFromImages(images, scale, cv::Size(input_width, input_height), mean, swap_rb);
+}
+
+/**
+ * Read a manifest file. Unknown keys are an error, so a typo does not silently
+ * feed a model the wrong input.
+ */
+ModelManifest ModelManifest::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Could not read model manifest: " + path);
+
+    auto directory = std::filesystem::path(path).parent_path();
+    auto resolve = [&directory](const std::string &file)
+    {
+        return file.empty() || file[0] == '/' ? file : (directory / file).string();
+    };
+
+    ModelManifest manifest;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+
+        if (line.front() == '[' && line.back() == ']')
+        {
+            manifest.models.push_back(ModelSpec{.name = trim(line.substr(1, line.size() - 2))});
+            continue;
+        }
+
+        auto separator = line.find('=');
+        if (separator == std::string::npos || manifest.models.empty())
+            throw std::runtime_error("Malformed model manifest line: " + line);
+
+        ModelSpec &spec = manifest.models.back();
+        std::string key = trim(line.substr(0, separator));
+        std::string value = trim(line.substr(separator + 1));
+
+        if (key == "role")
+        {
+            if (value != "detector" && value != "embedder")
+                throw std::runtime_error("Unknown model role: " + value);
+            spec.role = value == "detector" ? ModelRole::Detector : ModelRole::Embedder;
+        }
+        else if (key == "weights")
+            spec.weights = resolve(value);
+        else if (key == "config")
+            spec.config = resolve(value);
+        else if (key == "input")
+        {
+            auto x = value.find('x');
+            spec.input_width = std::stoi(value.substr(0, x));
+            spec.input_height = x == std::string::npos ? spec.input_width : std::stoi(value.substr(x + 1));
+        }
+        else if (key == "scale")
+            spec.scale = std::stod(value);
+        else if (key == "mean")
+        {
+            std::stringstream channels(value);
+            std::string channel;
+            for (int i = 0; i < 3 && std::getline(channels, channel, ','); i++)
+                spec.mean[i] = std::stod(channel);
+        }
+        else if (key == "swap_rb")
+            spec.swap_rb = value == "true";
+        else if (key == "output")
+        {
+            std::stringstream layers(value);
+            std::string layer;
+            spec.outputs.clear();
+            while (std::getline(layers, layer, ','))
+                spec.outputs.push_back(trim(layer));
+        }
+        else if (key == "decoder")
+        {
+            if (value != "ssd" && value != "yunet")
+                throw std::runtime_error("Unknown detection decoder: " + value);
+            spec.decoder = value;
+        }
+        else if (key == "threshold")
+            spec.threshold = std::stof(value);
+        else if (key == "nms_threshold")
+            spec.nms_threshold = std::stof(value);
+        else if (key == "top_k")
+            spec.top_k = std::stoi(value);
+        else if (key == "precision")
+            spec.precision = value;
+        else if (key == "accuracy")
+            spec.accuracy = std::stof(value);
+        else if (key == "embedding_width")
+            spec.embedding_width = std::stoi(value);
+        else
+            throw std::runtime_error("Unknown model manifest key: " + key);
+    }
+
+    for (const auto &spec : manifest.models)
+    {
+        if (spec.weights.empty() || spec.input_width <= 0 || spec.input_height <= 0)
+            throw std::runtime_error("Model " + spec.name + " needs weights and an input size");
+    }
+    return manifest;
+}
+
+/**
+ * The models that ship with irpam, for model directories without a manifest.
+ */
+ModelManifest ModelManifest::builtin(const std::string &directory)
+{
+    return ModelManifest{.models = {
+                             ModelSpec{
+                                 .name = "res10-ssd-fp16",
+                                 .role = ModelRole::Detector,
+                                 .weights = directory + "/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+                                 .config = directory + "/modelproto.txt",
+                                 .input_width = DETECTION_NET_WIDTH,
+                                 .input_height = DETECTION_NET_WIDTH,
+                                 .precision = "fp16"},
+                             ModelSpec{
+                                 .name = "arcface-r100-int8",
+                                 .role = ModelRole::Embedder,
+                                 .weights = directory + "/arcfaceresnet100-11-int8.onnx",
+                                 .input_width = EMBEDDING_NET_WIDTH,
+                                 .input_height = EMBEDDING_NET_WIDTH,
+                                 .scale = 1.0 / 128.0,
+                                 .outputs = {"fc1"},
+                                 .precision = "int8",
+                                 .embedding_width = EMBEDDING_WIDTH},
+                         }};
+}
+
+/**
+ * The manifest of a model directory, or the built-in models if it has none.
+ */
+ModelManifest ModelManifest::fromDirectory(const std::string &directory)
+{
+    std::string path = directory + "/manifest.txt";
+    return std::filesystem::exists(path) ? load(path) : builtin(directory);
+}
+
+/**
+ * The models are installed to `/opt/campam/models`. The `IRPAM_MODEL_DIR` environment
+ * variable overrides this, which is handy for running from a checkout.
+ */
+std::string ModelManifest::defaultDirectory()
+{
+    const char *directory = std::getenv("IRPAM_MODEL_DIR");
+    return directory ? directory : "/opt/campam/models";
+}
+
+std::vector<ModelSpec> ModelManifest::variants(ModelRole role) const
+{
+    std::vector<ModelSpec> matching;
+    std::copy_if(models.begin(), models.end(), std::back_inserter(matching), [role](const ModelSpec &spec)
+                 { return spec.role == role; });
+    return matching;
+}
+
+/**
+ * Pick the model of a role by name. An empty name picks the first variant in the
+ * manifest, and `auto` the fastest one that reaches the accuracy target. Embedders
+ * must produce embeddings of the width the enrolled ones have.
+ */
+ModelSpec ModelManifest::choose(ModelRole role, const std::string &name, float accuracy_target) const
+{
+    if (name == "auto")
+        return select_fastest(*this, role, accuracy_target);
+
+    for (const auto &spec : variants(role))
+    {
+        if (!name.empty() && spec.name != name)
+            continue;
+        if (role == ModelRole::Embedder && spec.embedding_width != EMBEDDING_WIDTH)
+            throw std::runtime_error("The embedding model " + spec.name + " has a width of " +
+                                     std::to_string(spec.embedding_width) + ", not " + std::to_string(EMBEDDING_WIDTH));
+        return spec;
+    }
+
+    throw std::runtime_error(name.empty() ? std::string("No ") + role_name(role) + " model in the manifest"
+                                          : "No " + std::string(role_name(role)) + " model named " + name);
+}
+
+ModelSpec select_fastest(const ModelManifest &manifest, ModelRole role, float accuracy_target,
+                         int runs, std::vector<ModelTiming> *timings)
+{
+    TRACE_SCOPE("model.select");
+    const ModelSpec *fastest = nullptr;
+    double fastest_ms = 0;
+
+    auto candidates = manifest.variants(role);
+    for (const auto &spec : candidates)
+    {
+        if (spec.accuracy < accuracy_target)
+            continue;
+        if (role == ModelRole::Embedder && spec.embedding_width != EMBEDDING_WIDTH)
+            continue;
+
+        cv::dnn::Net net;
+        try
+        {
+            net = cv::dnn::readNet(spec.weights, spec.config);
+        }
+        catch (const cv::Exception &)
+        {
+            continue;
+        }
+        if (net.empty())
+            continue;
+
+        cv::Mat input(spec.input_height, spec.input_width, CV_8UC3, cv::Scalar::all(128));
+        std::vector<cv::Mat> results;
+        auto forward = [&]()
+        {
+            if (spec.outputs.empty())
+                net.forward();
+            else
+                net.forward(results, spec.outputs);
+        };
+
+        // A variant that loads but cannot run, e.g. a missing output layer, is skipped.
+        std::vector<double> samples;
+        try
+        {
+            net.setInput(spec.blobFromImages({input}));
+            forward();
+
+            for (int run = 0; run < std::max(1, runs); run++)
+            {
+                auto start = Clock::now();
+                forward();
+                samples.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+        }
+        catch (const std::exception &)
+        {
+            continue;
+        }
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        double median = samples[samples.size() / 2];
+
+        if (timings)
+            timings->push_back(ModelTiming{.name = spec.name, .median_ms = median});
+        if (!fastest || median < fastest_ms)
+        {
+            fastest = &spec;
+            fastest_ms = median;
+        }
+    }
+
+    if (!fastest)
+        throw std::runtime_error(std::string("No ") + role_name(role) + " model loads with an accuracy of at least " + std::to_string(accuracy_target));
+    return *fastest;
+}
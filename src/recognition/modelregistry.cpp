@@ -0,0 +1,342 @@
+#include "modelregistry.hpp"
+#include <chrono>
+#include "facedetector.hpp"
+#include "trace.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * The first detector and embedder listed in the manifest of a model directory.
+ */
+ModelPaths ModelPaths::fromDirectory(const std::string &directory)
+{
+    ModelManifest manifest = ModelManifest::fromDirectory(directory);
+    return ModelPaths{
+        .detector = manifest.choose(ModelRole::Detector, "", 0),
+        .embedder = manifest.choose(ModelRole::Embedder, "", 0)};
+}
+
+ModelPaths ModelPaths::defaults()
+{
+    return fromDirectory(ModelManifest::defaultDirectory());
+}
+
+/**
+ * Parse a CPU list like `2,3` or `0-3,6`, in the format of taskset and cgroups.
+ */
+std::vector<int> InferenceConfig::parseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        if (range.find_first_not_of(" \t") == std::string::npos)
+            continue;
+
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            throw std::runtime_error("Invalid CPU list: " + list);
+
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+ModelRegistry::ModelRegistry()
+    : paths(ModelPaths::defaults()), embedder_spec(std::make_shared<const ModelSpec>(paths.embedder))
+{
+}
+
+/**
+ * Point the registry at a different set of models. Models that were already loaded
+ * are dropped and get loaded again from the new paths on next use.
+ */
+void ModelRegistry::configure(const ModelPaths &new_paths)
+{
+    std::scoped_lock guard(paths_lock, detector.lock, embedder.lock);
+    paths = new_paths;
+    face_detector.reset();
+    embedder_spec = std::make_shared<const ModelSpec>(paths.embedder);
+    generation++;
+    for (Model *model : {&detector, &embedder})
+    {
+        model->net = cv::dnn::Net();
+        model->outputs.clear();
+        model->loaded = false;
+        model->metrics = {};
+    }
+}
+
+ModelPaths ModelRegistry::getPaths() const
+{
+    std::lock_guard guard(paths_lock);
+    return paths;
+}
+
+/**
+ * The `FaceDetector` of the detection model in use. It is made once per
+ * configuration, rather than for every frame.
+ */
+std::shared_ptr<const FaceDetector> ModelRegistry::getDetector() const
+{
+    std::lock_guard guard(paths_lock);
+    if (!face_detector)
+        face_detector = FaceDetector::create(paths.detector);
+    return face_detector;
+}
+
+/**
+ * The spec of the embedding model in use, for the code that prepares its input.
+ */
+std::shared_ptr<const ModelSpec> ModelRegistry::getEmbedder() const
+{
+    std::lock_guard guard(paths_lock);
+    return embedder_spec;
+}
+
+uint64_t ModelRegistry::getGeneration() const
+{
+    return generation.load();
+}
+
+/**
+ * Set the thread budget of inference. It takes effect on the next forward pass,
+ * which runs on a new `InferenceThread`; zero and empty values go back to the
+ * affinity and priority of the process.
+ */
+void ModelRegistry::configureInference(const InferenceConfig &config)
+{
+    if (config.threads < 0)
+        throw std::runtime_error("The number of inference threads cannot be negative");
+    for (int cpu : config.cpus)
+    {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+            throw std::runtime_error("Invalid inference CPU: " + std::to_string(cpu));
+    }
+
+    // With both model locks held, no forward pass is running on the old thread.
+    std::scoped_lock guard(paths_lock, detector.lock, embedder.lock, inference_lock);
+    inference = config;
+    // A negative count makes OpenCV go back to its default.
+    cv::setNumThreads(config.threads > 0 ? config.threads : -1);
+    inference_thread.reset();
+}
+
+InferenceConfig ModelRegistry::getInferenceConfig() const
+{
+    std::scoped_lock guard(detector.lock, embedder.lock);
+    return inference;
+}
+
+/**
+ * The thread to run forward passes on, started with the current config. A model
+ * lock must be held.
+ */
+InferenceThread &ModelRegistry::getInferenceThread()
+{
+    std::lock_guard guard(inference_lock);
+    if (!inference_thread)
+        inference_thread = std::make_unique<InferenceThread>(inference);
+    return *inference_thread;
+}
+
+/**
+ * Start the thread, pinned to the CPUs of the config and at its priority. Throws
+ * if either cannot be set.
+ */
+InferenceThread::InferenceThread(const InferenceConfig &config)
+{
+    std::promise<void> started;
+    std::future<void> result = started.get_future();
+    thread = std::thread([this, &config, &started]()
+                         {
+        try
+        {
+            if (!config.cpus.empty())
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu : config.cpus)
+                    CPU_SET(cpu, &set);
+
+                int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                if (error != 0)
+                    throw std::runtime_error("Could not pin inference to its CPUs: " + std::string(strerror(error)));
+            }
+
+            // Nice values are per thread on Linux.
+            if (config.nice != 0 && setpriority(PRIO_PROCESS, syscall(SYS_gettid), config.nice) < 0)
+                throw std::runtime_error("Could not set the inference priority: " + std::string(strerror(errno)));
+        }
+        catch (...)
+        {
+            started.set_exception(std::current_exception());
+            return;
+        }
+        started.set_value();
+        loop(); });
+
+    try
+    {
+        result.get();
+    }
+    catch (...)
+    {
+        thread.join();
+        throw;
+    }
+}
+
+InferenceThread::~InferenceThread()
+{
+    {
+        std::lock_guard guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void InferenceThread::loop()
+{
+    std::unique_lock guard(lock);
+    while (true)
+    {
+        wake.wait(guard, [this]()
+                  { return stopping || !tasks.empty(); });
+        if (tasks.empty())
+            return;
+
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        guard.unlock();
+        task();
+        guard.lock();
+    }
+}
+
+void InferenceThread::call(const std::function<void()> &task)
+{
+    std::packaged_task<void()> packaged(task);
+    std::future<void> done = packaged.get_future();
+    {
+        std::lock_guard guard(lock);
+        tasks.push_back([&packaged]()
+                        { packaged(); });
+    }
+    wake.notify_one();
+    done.get();
+}
+
+/**
+ * Load both models up front, so the first authentication does not pay for it.
+ */
+void ModelRegistry::preload()
+{
+    {
+        std::lock_guard guard(detector.lock);
+        load(detector, true);
+    }
+    {
+        std::lock_guard guard(embedder.lock);
+        load(embedder, false);
+    }
+}
+
+/**
+ * Read a model from disk if it is not loaded yet. The model lock must be held.
+ */
+void ModelRegistry::load(Model &model, bool is_detector)
+{
+    if (model.loaded)
+        return;
+
+    TRACE_SCOPE("model.load");
+    ModelPaths current = getPaths();
+    const ModelSpec &spec = is_detector ? current.detector : current.embedder;
+    auto start = Clock::now();
+
+    // The framework is picked from the file extension, so any variant in the manifest loads.
+    model.net = cv::dnn::readNet(spec.weights, spec.config);
+
+    if (model.net.empty())
+        throw std::runtime_error("Failed to load model: " + spec.weights);
+
+    model.outputs = spec.outputs;
+    model.loaded = true;
+    model.metrics.load_ms = elapsed_ms(start);
+}
+
+std::vector<cv::Mat> ModelRegistry::run(Model &model, bool is_detector, const cv::Mat &blob)
+{
+    std::lock_guard guard(model.lock);
+    load(model, is_detector);
+    InferenceThread &thread = getInferenceThread();
+
+    TRACE_SCOPE(is_detector ? "detect.forward" : "embed.forward");
+    auto start = Clock::now();
+    std::vector<cv::Mat> results;
+    thread.call([&]()
+                {
+        model.net.setInput(blob);
+        // The output blobs are owned by the network and are overwritten by the next forward pass.
+        if (model.outputs.empty())
+            results.push_back(model.net.forward());
+        else
+            model.net.forward(results, model.outputs);
+        for (auto &result : results)
+            result = result.clone(); });
+
+    model.metrics.last_inference_ms = elapsed_ms(start);
+    model.metrics.total_inference_ms += model.metrics.last_inference_ms;
+    model.metrics.inferences++;
+    return results;
+}
+
+/**
+ * Run the face detector on a prepared blob. Returns one blob per output layer of
+ * its spec, in the order of the spec.
+ */
+std::vector<cv::Mat> ModelRegistry::detect(const cv::Mat &blob)
+{
+    return run(detector, true, blob);
+}
+
+/**
+ * Run the embedding network on a prepared blob, reading the output layer of its spec.
+ */
+cv::Mat ModelRegistry::embed(const cv::Mat &blob)
+{
+    return run(embedder, false, blob).front();
+}
+
+ModelMetrics ModelRegistry::getDetectorMetrics() const
+{
+    std::lock_guard guard(detector.lock);
+    return detector.metrics;
+}
+
+ModelMetrics ModelRegistry::getEmbeddingMetrics() const
+{
+    std::lock_guard guard(embedder.lock);
+    return embedder.metrics;
+}
@@ -1,84 +1,153 @@
 #include "recognition.hpp"
+#include <atomic>
+#include "trace.hpp"
+#include "modelregistry.hpp"
+#include "matcher.hpp"
+#include "alignment.hpp"
+#include "facedetector.hpp"
 
-std::optional<cv::Mat> extract_face(const cv::Mat &input_image)
+/**
+ * The networks are trained on 3-channel 8-bit images. Luma frames are kept
+ * single-channel all the way through capture and preprocessing, and only get
+ * their channels replicated here, right before they are turned into a blob.
+ */
+cv::Mat to_network_input(const cv::Mat &image)
 {
-    int image_width = input_image.size[1];
-    int image_height = input_image.size[0];
-
-    // Prepare input to NN
-    cv::Mat resized_image;
-    cv::resize(input_image, resized_image, cv::Size(DETECTION_NET_WIDTH, DETECTION_NET_WIDTH), 1.0);
-    auto blob = cv::dnn::blobFromImage(resized_image);
+    if (image.channels() == 3)
+        return image;
 
-    // Prep + run NN
-    auto detection_model = cv::dnn::readNetFromCaffe(
-        "models/modelproto.txt",
-        "models/res10_300x300_ssd_iter_140000_fp16.caffemodel");
+    cv::Mat luma = image;
+    if (image.depth() == CV_16U)
+        image.convertTo(luma, CV_8U, 1.0 / 256.0);
 
-    detection_model.setInput(blob);
-    auto detections = detection_model.forward();
+    cv::Mat bgr;
+    cv::cvtColor(luma, bgr, cv::COLOR_GRAY2BGR);
+    return bgr;
+}
 
-    std::vector<DetectedFace> faces;
-    for (int i = 0; i < detections.size[2]; ++i)
-    {
-        float confidence = detections.ptr<float>(0, 0, i)[2];
-        int x = static_cast<int>(detections.ptr<float>(0, 0, i)[3] * image_width);
-        int y = static_cast<int>(detections.ptr<float>(0, 0, i)[4] * image_height);
-        int endx = static_cast<int>(detections.ptr<float>(0, 0, i)[5] * image_width);
-        int endy = static_cast<int>(detections.ptr<float>(0, 0, i)[6] * image_height);
-
-        if (confidence > 0.8)
-            faces.push_back(DetectedFace{
-                .x = x,
-                .y = y,
-                .w = endx - x,
-                .h = endy - y,
-                .size = (endx - x) * (endy - y),
-                .confidence = confidence});
-    }
+std::vector<DetectedFace> detect_faces(const cv::Mat &input_image)
+{
+    TRACE_SCOPE("detect.detect_faces");
+    return ModelRegistry::getInstance().getDetector()->detect(input_image);
+}
 
-    std::sort(faces.begin(), faces.end(), [](DetectedFace face1, DetectedFace face2)
-              { return face1.size > face2.size; });
+std::optional<DetectedFace> detect_face(const cv::Mat &input_image)
+{
+    TRACE_SCOPE("detect.detect_face");
+    std::vector<DetectedFace> faces = ModelRegistry::getInstance().getDetector()->detect(input_image, 1);
 
     // Get + return the largest face we could find.
     if (faces.empty())
-    {
         return std::nullopt;
-    }
-    else
-    {
-        auto face = faces[0];
-        int x = std::max(0, face.x);
-        int y = std::max(0, face.y);
-        int w = std::min(input_image.cols - face.x, face.w);
-        int h = std::min(input_image.rows - face.y, face.h);
+    return std::move(faces.front());
+}
 
-        cv::Rect roi(x, y, w, h);
-        cv::Mat cropped = input_image(roi).clone();
+cv::Mat crop_face(const cv::Mat &input_image, const DetectedFace &face)
+{
+    int x = std::max(0, face.x);
+    int y = std::max(0, face.y);
+    int w = std::min(input_image.cols - face.x, face.w);
+    int h = std::min(input_image.rows - face.y, face.h);
+
+    cv::Rect roi(x, y, w, h);
+    return input_image(roi).clone();
+}
 
-        return cropped;
+cv::Mat face_image(const cv::Mat &input_image, const DetectedFace &face)
+{
+    // With landmarks, the face goes straight from the frame to the embedding input.
+    if (face.landmarks.size() == ARCFACE_TEMPLATE.size())
+    {
+        auto embedder = ModelRegistry::getInstance().getEmbedder();
+        return align_face(input_image, face.landmarks, embedder->input_width, embedder->input_height);
     }
+    return crop_face(input_image, face);
+}
+
+std::optional<cv::Mat> extract_face(const cv::Mat &input_image)
+{
+    TRACE_SCOPE("detect.extract_face");
+    auto face = detect_face(input_image);
+    if (!face.has_value())
+        return std::nullopt;
+    return face_image(input_image, face.value());
 }
 
 cv::Mat get_embedding(const cv::Mat &image)
 {
-    auto net = cv::dnn::readNetFromONNX("/home/sandesh/workspace/opencv-testing/arcfaceresnet100-11-int8.onnx");
-    net.setInput(image);
-    return net.forward("fc1");
+    return ModelRegistry::getInstance().embed(image);
 }
 
-bool are_similar(const cv::Mat &first, const cv::Mat &second)
+cv::Mat face_embedding(const cv::Mat &face)
 {
-    auto blob1 = cv::dnn::blobFromImage(first, 1.0 / 128.0, cv::Size(EMBEDDING_NET_WIDTH, EMBEDDING_NET_WIDTH));
-    auto blob2 = cv::dnn::blobFromImage(second, 1.0 / 128.0, cv::Size(EMBEDDING_NET_WIDTH, EMBEDDING_NET_WIDTH));
+    TRACE_SCOPE("embed.face_embedding");
+    auto blob = ModelRegistry::getInstance().getEmbedder()->blobFromImages({to_network_input(face)});
+    return get_embedding(blob).reshape(1, 1);
+}
 
-    auto embedding1 = get_embedding(blob1);
-    auto embedding2 = get_embedding(blob2);
+cv::Mat face_embeddings(const std::vector<cv::Mat> &faces)
+{
+    TRACE_SCOPE("embed.face_embeddings");
+    // Some exported models have the batch dimension fixed to one. Once a batched
+    // forward pass has failed, every later call goes straight to the fallback.
+    static std::atomic<bool> batch_supported = true;
+
+    if (faces.empty())
+        return cv::Mat(0, EMBEDDING_WIDTH, CV_32F);
+
+    if (faces.size() > 1 && batch_supported)
+    {
+        std::vector<cv::Mat> inputs;
+        inputs.reserve(faces.size());
+        for (const auto &face : faces)
+            inputs.push_back(to_network_input(face));
+
+        auto blob = ModelRegistry::getInstance().getEmbedder()->blobFromImages(inputs);
+        try
+        {
+            return get_embedding(blob).reshape(1, static_cast<int>(faces.size()));
+        }
+        catch (const cv::Exception &)
+        {
+            batch_supported = false;
+        }
+    }
+
+    cv::Mat embeddings;
+    std::vector<cv::Mat> rows;
+    rows.reserve(faces.size());
+    for (const auto &face : faces)
+        rows.push_back(face_embedding(face));
+    cv::vconcat(rows, embeddings);
+    return embeddings;
+}
 
-    auto dot_product = embedding1.dot(embedding2);
-    auto norm1 = cv::norm(embedding1);
-    auto norm2 = cv::norm(embedding2);
+static float cosine_similarity(const cv::Mat &first, const cv::Mat &second)
+{
+    auto dot_product = first.dot(second);
+    auto norm1 = cv::norm(first);
+    auto norm2 = cv::norm(second);
+
+    return dot_product / (norm1 * norm2);
+}
 
-    auto cosine_similarity = dot_product / (norm1 * norm2);
-    return cosine_similarity >= face_threshold;
-}
\ No newline at end of file
+float best_similarity(const cv::Mat &embedding, const cv::Mat &enrolled)
+{
+    if (enrolled.empty())
+        return -1;
+
+    return EmbeddingMatcher(enrolled).best(embedding).score;
+}
+
+bool matches_enrolled(const cv::Mat &embedding, const cv::Mat &enrolled)
+{
+    return best_similarity(embedding, enrolled) >= face_threshold;
+}
+
+bool are_similar(const cv::Mat &first, const cv::Mat &second)
+{
+    auto embedding1 = face_embedding(first);
+    auto embedding2 = face_embedding(second);
+
+    return cosine_similarity(embedding1, embedding2) >= face_threshold;
+}
@@ -0,0 +1,93 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A finished span of work on one thread.
+ */
+struct TraceEvent
+{
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t thread;
+};
+
+/**
+ * @brief Process-wide trace recorder. This is a singleton object.
+ *
+ * Spans are kept in a fixed-size ring buffer, so tracing never allocates and
+ * a long-running daemon only keeps the most recent events. Tracing is always
+ * compiled in; while it is disabled a `TRACE_SCOPE` costs a single relaxed
+ * atomic load. It is enabled with `enable()`, or by setting the `IRPAM_TRACE`
+ * environment variable before the program starts.
+ */
+class Tracer
+{
+private:
+    static constexpr size_t CAPACITY = 4096;
+
+    static std::atomic<bool> active;
+    std::array<TraceEvent, CAPACITY> events;
+    size_t recorded = 0;
+    mutable std::mutex lock;
+    Tracer();
+
+public:
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+    static Tracer &getInstance()
+    {
+        static Tracer instance;
+        return instance;
+    }
+
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+    static uint64_t now_ns();
+
+    void enable(bool on = true);
+    void record(const char *name, uint64_t start_ns, uint64_t end_ns);
+    std::vector<TraceEvent> snapshot() const;
+    void clear();
+
+    void log() const;
+    void writeChromeTrace(const std::string &path) const;
+};
+
+/**
+ * @brief Records the lifetime of the enclosing scope as a trace event.
+ */
+class ScopedTrace
+{
+private:
+    const char *name;
+    uint64_t start;
+
+public:
+    explicit ScopedTrace(const char *name)
+        : name(name), start(Tracer::enabled() ? Tracer::now_ns() : 0) {}
+
+    ScopedTrace(const ScopedTrace &) = delete;
+    ScopedTrace &operator=(const ScopedTrace &) = delete;
+
+    ~ScopedTrace()
+    {
+        if (start != 0)
+            Tracer::getInstance().record(name, start, Tracer::now_ns());
+    }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Names must be string literals: only the pointer is stored.
+#define TRACE_SCOPE(name) ScopedTrace TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,123 @@
+#include "trace.hpp"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+// Read before `main()`, so that scopes trace even if nothing touched the tracer yet.
+std::atomic<bool> Tracer::active = std::getenv("IRPAM_TRACE") != nullptr;
+
+static uint32_t thread_number()
+{
+    static std::atomic<uint32_t> next = 1;
+    thread_local uint32_t number = next++;
+    return number;
+}
+
+Tracer::Tracer() = default;
+
+uint64_t Tracer::now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Tracer::enable(bool on)
+{
+    active = on;
+}
+
+void Tracer::record(const char *name, uint64_t start_ns, uint64_t end_ns)
+{
+    uint32_t thread = thread_number();
+    std::lock_guard guard(lock);
+    events[recorded % CAPACITY] = TraceEvent{
+        .name = name,
+        .start_ns = start_ns,
+        .duration_ns = end_ns - start_ns,
+        .thread = thread};
+    recorded++;
+}
+
+/**
+ * Copy out the recorded events, oldest first.
+ */
+std::vector<TraceEvent> Tracer::snapshot() const
+{
+    std::lock_guard guard(lock);
+    std::vector<TraceEvent> result;
+    size_t count = std::min(recorded, CAPACITY);
+    result.reserve(count);
+    for (size_t i = recorded - count; i < recorded; i++)
+        result.push_back(events[i % CAPACITY]);
+    return result;
+}
+
+void Tracer::clear()
+{
+    std::lock_guard guard(lock);
+    recorded = 0;
+}
+
+/**
+ * Write every recorded event to the log, one line each.
+ */
+void Tracer::log() const
+{
+    for (const auto &event : snapshot())
+    {
+        spdlog::info("trace {} thread={} {:.3f}ms", event.name, event.thread, event.duration_ns / 1e6);
+    }
+}
+
+/**
+ * Write the recorded events in the Chrome trace event format, which can be
+ * opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * The daemon writes traces as root, so the file is never opened through a
+ * symlink, and is only readable by its owner.
+ */
+void Tracer::writeChromeTrace(const std::string &path) const
+{
+    std::ostringstream file;
+    auto events = snapshot();
+    // Timestamps are microseconds since boot; the default precision would round hours
+    // of uptime to tens of milliseconds.
+    file << std::fixed << std::setprecision(3);
+    file << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const auto &event = events[i];
+        file << (i ? "," : "") << "\n{\"name\":\"" << event.name
+             << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+             << ",\"ts\":" << event.start_ns / 1000.0
+             << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+    }
+    file << "\n]}\n";
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Could not open trace file for writing: " + path + ": " + strerror(errno));
+
+    std::string contents = file.str();
+    size_t written = 0;
+    while (written < contents.size())
+    {
+        ssize_t count = ::write(fd, contents.data() + written, contents.size() - written);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Could not write trace file: " + path + ": " + strerror(errno));
+        }
+        written += count;
+    }
+    ::close(fd);
+}
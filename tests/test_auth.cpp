@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "authengine.hpp"
+#include "boundedqueue.hpp"
+
+TEST(bounded_queue, DropsOldestWhenFull)
+{
+    BoundedQueue<int> queue(2);
+    queue.push(1);
+    queue.push(2);
+    queue.push(3);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    EXPECT_EQ(queue.pop_until(deadline), 2);
+    EXPECT_EQ(queue.pop_until(deadline), 3);
+    EXPECT_EQ(queue.droppedCount(), 1u);
+}
+
+TEST(bounded_queue, CloseWakesConsumer)
+{
+    BoundedQueue<int> queue(2);
+    std::thread closer([&queue]()
+                       {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.close(); });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    EXPECT_FALSE(queue.pop_until(deadline).has_value());
+    EXPECT_LT(std::chrono::steady_clock::now(), deadline);
+    EXPECT_FALSE(queue.push(1));
+    closer.join();
+}
+
+TEST(auth_engine, StopsAtDeadlineWithoutFrames)
+{
+    AuthEngine engine(AuthConfig{.deadline = std::chrono::milliseconds(100)});
+    EmbeddingMatcher matcher(EMBEDDING_WIDTH);
+
+    // A camera that never delivers waits as long as it is allowed to.
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point given;
+    auto result = engine.authenticate([&given](std::chrono::steady_clock::time_point deadline) -> std::unique_ptr<ImageBuffer>
+                                      {
+        given = deadline;
+        std::this_thread::sleep_until(deadline);
+        return nullptr; }, matcher);
+
+    EXPECT_FALSE(result.matched);
+    EXPECT_EQ(result.frames_captured, 0);
+    EXPECT_LE(given - start, std::chrono::milliseconds(100));
+    EXPECT_LT(result.elapsed, std::chrono::seconds(1));
+}
+
+TEST(auth_engine, ReportsCaptureErrors)
+{
+    AuthEngine engine;
+    EmbeddingMatcher matcher(EMBEDDING_WIDTH);
+
+    auto result = engine.authenticate([](std::chrono::steady_clock::time_point) -> std::unique_ptr<ImageBuffer>
+                                      { throw std::runtime_error("camera unplugged"); }, matcher);
+
+    EXPECT_FALSE(result.matched);
+    EXPECT_EQ(result.error, "camera unplugged");
+    EXPECT_LT(result.elapsed, std::chrono::seconds(1));
+}
+
+TEST(auth_engine, DropsFramesCapturedBeforeTheAttempt)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 8, 8);
+    auto asked = std::chrono::steady_clock::now();
+    AuthEngine engine(AuthConfig{.deadline = std::chrono::milliseconds(100), .max_frames = 3, .not_before = asked});
+    EmbeddingMatcher matcher(EMBEDDING_WIDTH);
+
+    auto result = engine.authenticate([&](std::chrono::steady_clock::time_point)
+                                      {
+        std::vector<unsigned char> pixels(format.buffersize, 100);
+        auto frame = std::make_unique<ImageBuffer>(pixels.data(), pixels.size(), format);
+        frame->setCaptureTime(asked - std::chrono::seconds(5));
+        return frame; }, matcher);
+
+    EXPECT_GT(result.frames_stale, 0);
+    EXPECT_EQ(result.frames_captured, 0);
+    EXPECT_EQ(result.frames_processed, 0);
+}
@@ -1,6 +1,10 @@
+#include <filesystem>
+#include <fstream>
+#include <vector>
 #include <thread>
 #include <gtest/gtest.h>
 #include "cameramanager.hpp"
+#include "iremitter.hpp"
 #include "stb_image_write.hpp"
 
 TEST(checkDevices, AtLeastOneCameraPresent)
@@ -31,7 +35,7 @@ TEST(checkCapture, DoubleTrouble)
         std::shared_ptr<VideoDevice> camera = manager.get_camera_from_index(1);
         std::unique_ptr<ImageBuffer> buffer = camera.get()->grab({.fourcc = v4l2_fourcc('G', 'R', 'E', 'Y'), .width = 400, .height = 400});
 
-        stbi_write_jpg("test_luma.jpg", buffer.get()->getFormat().width, buffer.get()->getFormat().height, 3, buffer.get()->getData(), 100);
+        stbi_write_jpg("test_luma.jpg", buffer.get()->getFormat().width, buffer.get()->getFormat().height, buffer.get()->getFormat().channels, buffer.get()->getData(), 100);
     };
 
     // Start the threads
@@ -41,4 +45,63 @@ TEST(checkCapture, DoubleTrouble)
     // Wait for the threads to finish
     t1.join();
     t2.join();
-}
\ No newline at end of file
+}
+
+TEST(checkCapture, SessionStreamsFrames)
+{
+    CameraManager &manager = CameraManager::getInstance();
+    std::shared_ptr<VideoDevice> camera = manager.get_camera_from_index(0);
+    auto session = camera->startSession({.fourcc = v4l2_fourcc('M', 'J', 'P', 'G'), .width = 640, .height = 480});
+
+    for (int i = 0; i < 3; i++)
+    {
+        std::unique_ptr<ImageBuffer> buffer = session->next();
+        EXPECT_EQ(buffer->getFormat().width, session->getFormat().width);
+        EXPECT_EQ(buffer->getSize(), session->getFormat().buffersize);
+    }
+}
+
+TEST(checkCapture, BorrowedFrameIsNotCopied)
+{
+    CameraManager &manager = CameraManager::getInstance();
+    std::shared_ptr<VideoDevice> camera = manager.get_camera_from_index(1);
+    auto session = camera->startSession({.fourcc = v4l2_fourcc('G', 'R', 'E', 'Y'), .width = 400, .height = 400});
+
+    Frame frame = session->nextFrame();
+    cv::Mat view = frame.as_mat();
+    EXPECT_EQ(view.data, frame.getData());
+    EXPECT_EQ(view.cols, static_cast<int>(frame.getFormat().width));
+}
+
+TEST(irEmitter, ReadsControlsPerDevice)
+{
+    auto path = std::filesystem::temp_directory_path() / "irpam_emitters_test.conf";
+    {
+        std::ofstream file(path);
+        file << "# Dell Latitude\n"
+             << "[Integrated IR Camera]\n"
+             << "unit = 14\n"
+             << "selector = 0x06\n"
+             << "value = 1, 3, 3, 0\n"
+             << "[/dev/video2]\n"
+             << "unit = 4\n"
+             << "selector = 2\n"
+             << "value = 1\n";
+    }
+
+    auto controls = EmitterControl::load(path.string());
+    ASSERT_EQ(controls.size(), 2u);
+    EXPECT_EQ(controls[0].device, "Integrated IR Camera");
+    EXPECT_EQ(controls[0].unit, 14);
+    EXPECT_EQ(controls[0].selector, 6);
+    EXPECT_EQ(controls[0].value, (std::vector<uint8_t>{1, 3, 3, 0}));
+    EXPECT_EQ(controls[1].device, "/dev/video2");
+
+    {
+        std::ofstream file(path);
+        file << "[Integrated IR Camera]\nunit = 14\nvalue = 300\n";
+    }
+    EXPECT_THROW(EmitterControl::load(path.string()), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
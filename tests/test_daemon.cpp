@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include "authservice.hpp"
+#include "protocol.hpp"
+
+TEST(protocol, RequestRoundTrip)
+{
+    AuthRequest parsed;
+    ASSERT_TRUE(parse_request(format_request(AuthRequest{.user = "alice", .timeout = std::chrono::milliseconds(1500)}), parsed));
+    EXPECT_EQ(parsed.user, "alice");
+    EXPECT_EQ(parsed.timeout, std::chrono::milliseconds(1500));
+
+    EXPECT_FALSE(parse_request("AUTH alice", parsed));
+    EXPECT_FALSE(parse_request("HELLO alice 100", parsed));
+}
+
+TEST(protocol, RejectsUserNamesNoAccountCanHave)
+{
+    AuthRequest parsed;
+    EXPECT_TRUE(parse_request("AUTH alice.smith@corp 100", parsed));
+    EXPECT_FALSE(parse_request("AUTH alice 100 bob", parsed));
+    EXPECT_FALSE(parse_request(std::string("AUTH ali\0ce 100", 15), parsed));
+    EXPECT_FALSE(parse_request("AUTH al\x01ice 100", parsed));
+    EXPECT_FALSE(parse_request("AUTH -alice 100", parsed));
+    EXPECT_FALSE(parse_request("AUTH ../alice 100", parsed));
+    EXPECT_FALSE(parse_request("AUTH " + std::string(LOGIN_NAME_MAX, 'a') + " 100", parsed));
+
+    EXPECT_FALSE(valid_user_name("alice bob"));
+    EXPECT_FALSE(valid_user_name("alice\n"));
+    EXPECT_FALSE(valid_user_name("root:x"));
+    EXPECT_FALSE(valid_user_name(".."));
+    EXPECT_TRUE(valid_user_name("alice"));
+
+    // The client does not even send them.
+    EXPECT_EQ(request_authentication("/nonexistent/irpamd.sock", "alice\nAUTH root 100", std::chrono::milliseconds(100)).message,
+              "invalid user name");
+}
+
+TEST(protocol, ReplyRoundTrip)
+{
+    auto success = parse_reply(format_reply(AuthReply{.status = AuthReply::Status::Success, .score = 0.9f}));
+    EXPECT_EQ(success.status, AuthReply::Status::Success);
+    EXPECT_NEAR(success.score, 0.9f, 1e-5);
+
+    auto unavailable = parse_reply(format_reply(AuthReply{.message = "camera\nunplugged"}));
+    EXPECT_EQ(unavailable.status, AuthReply::Status::Unavailable);
+    EXPECT_EQ(unavailable.message, "camera unplugged");
+
+    EXPECT_EQ(parse_reply("garbage").status, AuthReply::Status::Unavailable);
+}
+
+TEST(protocol, ClientTalksToServer)
+{
+    auto path = (std::filesystem::temp_directory_path() / "irpamd_test.sock").string();
+    AuthServer server(path, [](const AuthRequest &request)
+                      { return AuthReply{
+                            .status = request.user == "alice" ? AuthReply::Status::Success : AuthReply::Status::Failure,
+                            .score = 0.5f}; });
+    std::thread serving([&server]()
+                        { server.serve(); });
+
+    EXPECT_EQ(request_authentication(path, "alice", std::chrono::milliseconds(500)).status, AuthReply::Status::Success);
+    EXPECT_EQ(request_authentication(path, "mallory", std::chrono::milliseconds(500)).status, AuthReply::Status::Failure);
+
+    server.stop();
+    serving.join();
+}
+
+TEST(protocol, MissingDaemonIsUnavailable)
+{
+    auto reply = request_authentication("/nonexistent/irpamd.sock", "alice", std::chrono::milliseconds(100));
+    EXPECT_EQ(reply.status, AuthReply::Status::Unavailable);
+}
+
+TEST(auth_service, ConfigReadsInferenceBudget)
+{
+    auto path = std::filesystem::temp_directory_path() / "irpamd_config_test.conf";
+    {
+        std::ofstream file(path);
+        file << "inference_threads = 2\n"
+             << "inference_cpus = 0-1,4 # keep off the desktop cores\n"
+             << "inference_nice = 5\n";
+    }
+
+    DaemonConfig config = DaemonConfig::load(path.string());
+    EXPECT_EQ(config.inference.threads, 2);
+    EXPECT_EQ(config.inference.cpus, (std::vector<int>{0, 1, 4}));
+    EXPECT_EQ(config.inference.nice, 5);
+    // Left to whether the camera has an emitter control.
+    EXPECT_FALSE(config.lit_frames.has_value());
+
+    std::filesystem::remove(path);
+}
+
+TEST(auth_service, ConfigReadsModelChoice)
+{
+    auto path = std::filesystem::temp_directory_path() / "irpamd_models_test.conf";
+    {
+        std::ofstream file(path);
+        file << "embedding_model = auto\n"
+             << "model_accuracy = 0.98\n"
+             << "track_template_frames = 0\n"
+             << "lit_frames = false\n";
+    }
+
+    DaemonConfig config = DaemonConfig::load(path.string());
+    EXPECT_TRUE(config.detector_model.empty());
+    EXPECT_EQ(config.embedding_model, "auto");
+    EXPECT_FLOAT_EQ(config.model_accuracy, 0.98f);
+    EXPECT_EQ(config.tracking.template_frames, 0);
+    EXPECT_FLOAT_EQ(config.tracking.window_scale, TrackerConfig{}.window_scale);
+    EXPECT_EQ(config.lit_frames, false);
+
+    std::filesystem::remove(path);
+}
+
+/**
+ * A camera that never sees a face. Like a streaming V4L2 device, it keeps frames
+ * captured while nobody was reading, until they are flushed.
+ */
+class FakeCamera : public FrameStream
+{
+private:
+    ImageFormat format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 8, 8);
+
+public:
+    std::deque<std::unique_ptr<ImageBuffer>> buffered;
+    int flushes = 0;
+    int handed_out = 0;
+
+    const ImageFormat &getFormat() const override { return format; }
+
+    std::unique_ptr<ImageBuffer> next() override
+    {
+        if (!buffered.empty())
+        {
+            auto frame = std::move(buffered.front());
+            buffered.pop_front();
+            handed_out++;
+            return frame;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return nullptr;
+    }
+
+    void flush() override
+    {
+        flushes++;
+        buffered.clear();
+    }
+
+    void capture(std::chrono::steady_clock::time_point when)
+    {
+        std::vector<unsigned char> pixels(format.buffersize, 100);
+        auto frame = std::make_unique<ImageBuffer>(pixels.data(), pixels.size(), format);
+        frame->setCaptureTime(when);
+        buffered.push_back(std::move(frame));
+    }
+};
+
+TEST(auth_service, FakeCameraStaysWarmBetweenRequests)
+{
+    auto directory = std::filesystem::temp_directory_path() / "irpamd_store_test";
+    std::filesystem::remove_all(directory);
+    EmbeddingStore(directory.string()).append("alice", cv::Mat(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(1)));
+
+    DaemonConfig config;
+    config.store_dir = directory.string();
+    config.timeout = 50;
+
+    int opened = 0;
+    AuthService service(config, [&opened]() -> std::shared_ptr<FrameStream>
+                        {
+        opened++;
+        return std::make_shared<FakeCamera>(); });
+
+    AuthRequest request{.user = "alice", .timeout = std::chrono::milliseconds(1000), .peer_uid = 0};
+    EXPECT_EQ(service.handle(request).status, AuthReply::Status::Failure);
+    EXPECT_EQ(service.handle(request).status, AuthReply::Status::Failure);
+    EXPECT_EQ(opened, 1);
+
+    request.user = "bob";
+    EXPECT_EQ(service.handle(request).status, AuthReply::Status::Unavailable);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(auth_service, SamplesOfOtherModelsAreNotScored)
+{
+    auto directory = std::filesystem::temp_directory_path() / "irpamd_origin_test";
+    std::filesystem::remove_all(directory);
+    EmbeddingOrigin other{.embedder = "some-other-embedder", .preparation = FacePreparation::Aligned};
+    EmbeddingStore(directory.string(), other).append("alice", cv::Mat(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(1)));
+
+    DaemonConfig config;
+    config.store_dir = directory.string();
+    config.timeout = 50;
+
+    int opened = 0;
+    AuthService service(config, [&opened]() -> std::shared_ptr<FrameStream>
+                        {
+        opened++;
+        return std::make_shared<FakeCamera>(); });
+
+    AuthReply reply = service.handle(AuthRequest{.user = "alice", .timeout = std::chrono::milliseconds(1000), .peer_uid = 0});
+    EXPECT_EQ(reply.status, AuthReply::Status::Unavailable);
+    EXPECT_NE(reply.message.find("enroll the user again"), std::string::npos);
+    EXPECT_EQ(opened, 0);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(auth_service, FramesLeftFromAnEarlierRequestAreNeverUsed)
+{
+    auto directory = std::filesystem::temp_directory_path() / "irpamd_stale_test";
+    std::filesystem::remove_all(directory);
+    EmbeddingStore(directory.string()).append("alice", cv::Mat(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(1)));
+
+    DaemonConfig config;
+    config.store_dir = directory.string();
+    config.timeout = 50;
+
+    auto camera = std::make_shared<FakeCamera>();
+    AuthService service(config, [camera]() -> std::shared_ptr<FrameStream>
+                        { return camera; });
+
+    AuthRequest request{.user = "alice", .timeout = std::chrono::milliseconds(1000), .peer_uid = 0};
+    service.handle(request);
+
+    // The driver fills the ring between requests.
+    for (int i = 0; i < 3; i++)
+        camera->capture(std::chrono::steady_clock::now());
+    service.handle(request);
+
+    EXPECT_EQ(camera->flushes, 1);
+    EXPECT_EQ(camera->handed_out, 0);
+
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "framepool.hpp"
+#include "image.hpp"
+#include "resize.hpp"
+
+TEST(imageFormat, LumaFormatsAreSingleChannel)
+{
+    auto grey = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 640, 480);
+    EXPECT_EQ(grey.channels, 1u);
+    EXPECT_EQ(grey.buffersize, 640 * 480);
+
+    auto y16 = ImageFormat::fromFourcc(V4L2_PIX_FMT_Y16, 640, 480);
+    EXPECT_EQ(y16.channels, 1u);
+    EXPECT_EQ(y16.buffersize, 640 * 480 * 2);
+
+    auto rgb = ImageFormat::fromFourcc(V4L2_PIX_FMT_RGB24, 640, 480);
+    EXPECT_EQ(rgb.channels, 3u);
+    EXPECT_EQ(rgb.buffersize, 640 * 480 * 3);
+}
+
+TEST(imageFormat, UnknownLayoutsAreEncoded)
+{
+    ImageFormat listed = {.fourcc = V4L2_PIX_FMT_GREY, .width = 640, .height = 480, .buffersize = 640 * 480};
+    EXPECT_EQ(listed.layout, PixelLayout::Encoded);
+    EXPECT_EQ(listed.channels, 0u);
+
+    auto mjpeg = ImageFormat::fromFourcc(V4L2_PIX_FMT_MJPEG, 640, 480);
+    EXPECT_EQ(mjpeg.layout, PixelLayout::Encoded);
+    EXPECT_EQ(mjpeg.channels, 0u);
+    EXPECT_EQ(mjpeg.buffersize, 0u);
+}
+
+TEST(imageBuffer, LumaStaysSingleChannel)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 64, 48);
+    std::vector<unsigned char> pixels(format.buffersize, 128);
+    ImageBuffer image(pixels.data(), pixels.size(), format);
+
+    auto resized = image.resizeTo(32, 24);
+    EXPECT_EQ(resized->getFormat().layout, PixelLayout::Grey);
+    EXPECT_EQ(resized->getSize(), 32 * 24);
+
+    auto cropped = image.cropImage(0.25, 0.25, 0.75, 0.75);
+    EXPECT_EQ(cropped->getSize(), 32 * 24);
+    EXPECT_EQ(cropped->to_mat().type(), CV_8UC1);
+}
+
+TEST(imageView, CropSharesPixelsWithParent)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 8, 4);
+    std::vector<unsigned char> pixels(format.buffersize);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = static_cast<unsigned char>(i);
+    ImageBuffer image(pixels.data(), pixels.size(), format);
+
+    auto view = image.cropView(0.25, 0.5, 0.75, 1.0);
+    EXPECT_EQ(view.getFormat().width, 4u);
+    EXPECT_EQ(view.getFormat().height, 2u);
+    EXPECT_EQ(view.getStride(), 8u);
+    EXPECT_EQ(view.getData(), static_cast<const char *>(image.getData()) + 2 * 8 + 2);
+
+    auto mat = view.as_mat();
+    EXPECT_EQ(mat.at<unsigned char>(1, 3), 3 * 8 + 5);
+}
+
+TEST(imageView, InvalidCropsThrow)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 8, 4);
+    std::vector<unsigned char> pixels(format.buffersize);
+    ImageBuffer image(pixels.data(), pixels.size(), format);
+
+    EXPECT_THROW(image.cropView(0.75, 0.0, 0.25, 1.0), std::runtime_error);
+    EXPECT_THROW(image.cropView(-0.25, 0.0, 0.5, 1.0), std::runtime_error);
+    EXPECT_THROW(image.cropView(0.0, 0.0, 1.0, 1.5), std::runtime_error);
+    EXPECT_THROW(image.cropView(0.5, 0.0, 0.55, 1.0), std::runtime_error);
+    EXPECT_THROW(image.cropImage(0.0, 0.5, 1.0, 0.5), std::runtime_error);
+    EXPECT_EQ(image.cropView(0.0, 0.0, 1.0, 1.0).getFormat().width, 8u);
+}
+
+TEST(imageView, MaterializeCopiesRowsOfStridedView)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_RGB24, 6, 4);
+    std::vector<unsigned char> pixels(format.buffersize);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = static_cast<unsigned char>(i);
+    ImageBuffer image(pixels.data(), pixels.size(), format);
+
+    auto cropped = image.cropImage(0.5, 0.25, 1.0, 0.75);
+    ASSERT_EQ(cropped->getFormat().width, 3u);
+    ASSERT_EQ(cropped->getFormat().height, 2u);
+    EXPECT_EQ(cropped->getSize(), 3u * 2 * 3);
+
+    auto data = static_cast<const unsigned char *>(cropped->getData());
+    for (unsigned int y = 0; y < 2; ++y)
+        for (unsigned int x = 0; x < 9; ++x)
+            EXPECT_EQ(data[y * 9 + x], pixels[(y + 1) * 18 + 9 + x]);
+}
+
+TEST(framePool, ReusesBuffersOfTheSameSize)
+{
+    FramePool pool;
+    const char *first;
+    {
+        auto buffer = pool.acquire(640 * 480);
+        first = buffer.get();
+    }
+
+    auto again = pool.acquire(640 * 480);
+    EXPECT_EQ(again.get(), first);
+
+    auto other = pool.acquire(320 * 240);
+    EXPECT_NE(other.get(), first);
+
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.allocations, 2u);
+    EXPECT_EQ(stats.reuses, 1u);
+    EXPECT_EQ(stats.idle, 0u);
+}
+
+TEST(framePool, ForgetsSizesNoLongerInUse)
+{
+    FramePool pool(8, 2);
+    pool.acquire(64);
+    pool.acquire(128);
+    pool.acquire(64);
+    // The shelf of 128 bytes was used least recently.
+    pool.acquire(256);
+
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.shelves, 2u);
+    EXPECT_EQ(stats.idle, 2u);
+
+    pool.acquire(128);
+    EXPECT_EQ(pool.getStats().allocations, 4u);
+}
+
+TEST(framePool, BuffersMayOutliveThePool)
+{
+    PooledBuffer buffer;
+    {
+        FramePool pool;
+        buffer = pool.acquire(64);
+    }
+    buffer.reset();
+}
+
+TEST(framePool, SteadyStateCropsDoNotAllocate)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 64, 48);
+    std::vector<unsigned char> pixels(format.buffersize);
+    ImageBuffer image(pixels.data(), pixels.size(), format);
+
+    image.cropImage(0.25, 0.25, 0.75, 0.75);
+    auto before = FramePool::getInstance().getStats();
+    for (int i = 0; i < 10; ++i)
+        image.cropImage(0.25, 0.25, 0.75, 0.75);
+    auto after = FramePool::getInstance().getStats();
+
+    EXPECT_EQ(after.allocations, before.allocations);
+    EXPECT_EQ(after.reuses, before.reuses + 10);
+}
+
+TEST(resize, KernelsAgreeOnEveryLayout)
+{
+    for (uint32_t fourcc : {V4L2_PIX_FMT_GREY, V4L2_PIX_FMT_Y16, V4L2_PIX_FMT_RGB24})
+    {
+        auto format = ImageFormat::fromFourcc(fourcc, 97, 61);
+        std::vector<unsigned char> pixels(format.buffersize);
+        for (size_t i = 0; i < pixels.size(); ++i)
+            pixels[i] = static_cast<unsigned char>(i * 31 + i / 7);
+        ImageView view(pixels.data(), format, format.width * format.bytesPerPixel());
+
+        for (auto filter : {ResizeFilter::Bilinear, ResizeFilter::Area})
+        {
+            size_t stride = 40 * format.bytesPerPixel();
+            std::vector<unsigned char> scalar(stride * 30), simd(stride * 30);
+            resize_into(view, scalar.data(), 40, 30, stride, filter, ResizeKernel::Scalar);
+            resize_into(view, simd.data(), 40, 30, stride, filter, bestResizeKernel());
+            EXPECT_EQ(scalar, simd);
+        }
+    }
+}
+
+TEST(resize, FlatImageStaysFlat)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 1280, 720);
+    std::vector<unsigned char> pixels(format.buffersize, 77);
+    ImageBuffer image(pixels.data(), pixels.size(), format);
+
+    for (auto [width, height] : {std::pair{300u, 300u}, std::pair{2000u, 1000u}})
+    {
+        auto resized = image.resizeTo(width, height);
+        auto data = static_cast<const unsigned char *>(resized->getData());
+        EXPECT_TRUE(std::all_of(data, data + resized->getSize(), [](unsigned char value)
+                                { return value == 77; }));
+    }
+}
@@ -0,0 +1,138 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "framequality.hpp"
+#include "warmup.hpp"
+
+static FrameStats flat_frame_stats(unsigned char luma)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 64, 48);
+    std::vector<unsigned char> pixels(format.buffersize, luma);
+    return FrameStats::measure(pixels.data(), format, format.width);
+}
+
+TEST(warmup, AcceptsFirstFrameOnceSettled)
+{
+    WarmupDetector detector;
+    EXPECT_FALSE(detector.accept(flat_frame_stats(40)));
+    EXPECT_FALSE(detector.accept(flat_frame_stats(90)));
+    EXPECT_TRUE(detector.accept(flat_frame_stats(91)));
+    EXPECT_EQ(detector.skipped(), 2);
+    EXPECT_TRUE(detector.isSettled());
+}
+
+TEST(warmup, ChangingExposureIsNotSettled)
+{
+    WarmupDetector detector;
+    EXPECT_FALSE(detector.accept(flat_frame_stats(90), 100));
+    EXPECT_FALSE(detector.accept(flat_frame_stats(90), 200));
+    EXPECT_TRUE(detector.accept(flat_frame_stats(90), 200));
+}
+
+TEST(warmup, GivesUpAfterMaxFrames)
+{
+    WarmupDetector detector(WarmupConfig{.max_frames = 4});
+    for (int i = 0; i < 3; i++)
+        EXPECT_FALSE(detector.accept(flat_frame_stats(0)));
+    EXPECT_TRUE(detector.accept(flat_frame_stats(0)));
+    EXPECT_FALSE(detector.isSettled());
+}
+
+TEST(warmup, IrAcceptsFirstLitFrame)
+{
+    WarmupDetector detector(WarmupConfig{.require_stable = false});
+    EXPECT_FALSE(detector.accept(flat_frame_stats(2)));
+    EXPECT_TRUE(detector.accept(flat_frame_stats(60)));
+    EXPECT_EQ(detector.skipped(), 1);
+}
+
+TEST(warmup, IrSkipsNothingWhenBlind)
+{
+    // Encoded frames without exposure metadata: IR cameras take the first one,
+    // others skip a fixed number.
+    WarmupDetector ir(WarmupConfig{.require_stable = false});
+    EXPECT_TRUE(ir.accept(FrameStats()));
+    EXPECT_EQ(ir.skipped(), 0);
+
+    WarmupDetector rgb(WarmupConfig{.blind_frames = 2});
+    EXPECT_FALSE(rgb.accept(FrameStats()));
+    EXPECT_FALSE(rgb.accept(FrameStats()));
+    EXPECT_TRUE(rgb.accept(FrameStats()));
+}
+
+// A 64x48 grey frame: every pixel `luma`, or a texture scaled to `luma` if `textured`.
+static std::vector<unsigned char> quality_frame(unsigned char luma, bool textured = false)
+{
+    std::vector<unsigned char> pixels(64 * 48, luma);
+    if (textured)
+    {
+        for (size_t i = 0; i < pixels.size(); ++i)
+            pixels[i] = static_cast<unsigned char>((i * 31 + i / 7) % 256 * luma / 255);
+    }
+    return pixels;
+}
+
+static FrameVerdict judge(FrameQualityGate &gate, const std::vector<unsigned char> &pixels)
+{
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 64, 48);
+    return gate.judge(ImageView(pixels.data(), format, format.width));
+}
+
+TEST(frameQuality, KernelsAgree)
+{
+    for (unsigned int width : {1u, 31u, 33u, 97u, 640u})
+    {
+        auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, width, 21);
+        std::vector<unsigned char> pixels(format.buffersize);
+        for (size_t i = 0; i < pixels.size(); ++i)
+            pixels[i] = static_cast<unsigned char>(i * 31 + i / 7);
+        ImageView view(pixels.data(), format, format.width);
+
+        auto scalar = FrameQuality::measure(view, QualityKernel::Scalar);
+        auto simd = FrameQuality::measure(view, bestQualityKernel());
+        EXPECT_DOUBLE_EQ(scalar.mean, simd.mean);
+        EXPECT_DOUBLE_EQ(scalar.stddev, simd.stddev);
+        EXPECT_DOUBLE_EQ(scalar.saturated, simd.saturated);
+        EXPECT_DOUBLE_EQ(scalar.sharpness, simd.sharpness);
+    }
+}
+
+TEST(frameQuality, RejectsFramesThatCannotMatch)
+{
+    FrameQualityGate gate(QualityConfig{.emitter_off_ratio = 0});
+    EXPECT_EQ(judge(gate, quality_frame(3)), FrameVerdict::Dark);
+    EXPECT_EQ(judge(gate, quality_frame(255)), FrameVerdict::Saturated);
+    EXPECT_EQ(judge(gate, quality_frame(100)), FrameVerdict::Flat);
+
+    // Brightness that only changes from row to row has contrast, but no edges.
+    auto ramp = quality_frame(0);
+    for (size_t i = 0; i < ramp.size(); ++i)
+        ramp[i] = static_cast<unsigned char>(40 + i / 64 * 2);
+    EXPECT_EQ(judge(gate, ramp), FrameVerdict::Blurry);
+
+    EXPECT_EQ(judge(gate, quality_frame(255, true)), FrameVerdict::Usable);
+    EXPECT_EQ(gate.rejected(), 4);
+    EXPECT_EQ(gate.getCounts()[static_cast<size_t>(FrameVerdict::Usable)], 1);
+}
+
+TEST(frameQuality, AlternatingEmitterFramesAreRejected)
+{
+    FrameQualityGate gate;
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(judge(gate, quality_frame(255, true)), FrameVerdict::Usable);
+        EXPECT_EQ(judge(gate, quality_frame(80, true)), FrameVerdict::EmitterOff);
+    }
+    EXPECT_EQ(gate.getCounts()[static_cast<size_t>(FrameVerdict::EmitterOff)], 3);
+}
+
+TEST(frameQuality, EncodedFramesPass)
+{
+    FrameQualityGate gate;
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_MJPEG, 64, 48);
+    std::vector<unsigned char> jpeg(16, 0xff);
+    ImageBuffer image(jpeg.data(), jpeg.size(), format);
+
+    EXPECT_FALSE(FrameQuality::measure(image).valid);
+    EXPECT_EQ(gate.judge(image), FrameVerdict::Usable);
+    EXPECT_EQ(gate.rejected(), 0);
+}
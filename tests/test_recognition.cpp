@@ -1,7 +1,18 @@
 #include <gtest/gtest.h>
+#include <cmath>
 #include <vector>
 #include "cameramanager.hpp"
 #include "recognition.hpp"
+#include "facedetector.hpp"
+#include "alignment.hpp"
+#include "facetracker.hpp"
+#include "modelregistry.hpp"
+#include "embeddingstore.hpp"
+#include "matcher.hpp"
+#include "replaysource.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sched.h>
 
 TEST(recognition_tests, BasicMatMul)
 {
@@ -16,6 +27,379 @@ TEST(recognition_tests, BasicMatMul)
     auto cv_image = (*buffer).to_mat();
     // Make sure it returns true for both same images.
     ASSERT_TRUE(are_similar(cv_image, cv_image));
+
+    // The embedding network is loaded once and reused for both images.
+    auto metrics = ModelRegistry::getInstance().getEmbeddingMetrics();
+    EXPECT_GT(metrics.load_ms, 0);
+    EXPECT_GE(metrics.inferences, 2u);
+}
+
+TEST(recognition_tests, BatchedEmbeddingsMatchSingle)
+{
+    CameraManager& camera_manager = CameraManager::getInstance();
+    std::shared_ptr<VideoDevice> device = camera_manager.get_camera_from_index(0);
+    auto session = device->startSession({
+        .fourcc = v4l2_fourcc('G', 'R', 'E', 'Y'),
+        .width = 400,
+        .height = 400
+    });
+
+    std::vector<cv::Mat> faces;
+    for (int i = 0; i < 3; i++)
+        faces.push_back(session->next()->to_mat());
+
+    cv::Mat batched = face_embeddings(faces);
+    ASSERT_EQ(batched.rows, 3);
+    ASSERT_EQ(batched.cols, EMBEDDING_WIDTH);
+
+    for (int i = 0; i < 3; i++)
+        EXPECT_GT(best_similarity(face_embedding(faces[i]), batched.row(i)), 0.99f);
+}
+
+TEST(recognition_tests, ReplayedFramesMatchThemselves)
+{
+    // A recording of a face, see `irpam_configure record`.
+    const char *fixture = std::getenv("IRPAM_REPLAY_FIXTURE");
+    if (fixture == nullptr)
+        GTEST_SKIP() << "IRPAM_REPLAY_FIXTURE is not set";
+
+    auto stream = ReplaySource(fixture).open({});
+    auto face = extract_face(stream->next()->to_mat());
+    ASSERT_TRUE(face.has_value());
+
+    cv::Mat enrolled = face_embedding(face.value());
+    int matched = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        auto next_face = extract_face(stream->next()->to_mat());
+        if (next_face.has_value() && matches_enrolled(face_embedding(next_face.value()), enrolled))
+            matched++;
+    }
+    EXPECT_GT(matched, 0);
+}
+
+TEST(face_tracker, FollowsTheFaceOfARecording)
+{
+    const char *fixture = std::getenv("IRPAM_REPLAY_FIXTURE");
+    if (fixture == nullptr)
+        GTEST_SKIP() << "IRPAM_REPLAY_FIXTURE is not set";
+
+    auto stream = ReplaySource(fixture).open({});
+    FaceTracker tracker;
+    int found = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        cv::Mat frame = stream->next()->to_mat();
+        auto face = tracker.track(frame);
+        if (!face.has_value())
+            continue;
+
+        found++;
+        // Wherever the face was found, it is where the detector would find it.
+        auto detected = detect_face(frame);
+        ASSERT_TRUE(detected.has_value());
+        cv::Rect tracked(face->x, face->y, face->w, face->h);
+        cv::Rect expected(detected->x, detected->y, detected->w, detected->h);
+        EXPECT_GT((tracked & expected).area(), expected.area() / 2);
+    }
+
+    TrackerStats stats = tracker.getStats();
+    EXPECT_GT(found, 0);
+    EXPECT_LT(stats.full_detections, 6);
+    EXPECT_EQ(stats.full_detections + stats.window_detections + stats.template_matches, 6);
+}
+
+TEST(model_registry, MissingModelsThrow)
+{
+    ModelRegistry &registry = ModelRegistry::getInstance();
+    registry.configure(ModelPaths::fromDirectory("/nonexistent"));
+
+    cv::Mat blob = cv::dnn::blobFromImage(cv::Mat(DETECTION_NET_WIDTH, DETECTION_NET_WIDTH, CV_8UC3));
+    EXPECT_ANY_THROW(registry.detect(blob));
+
+    registry.configure(ModelPaths::defaults());
+}
+
+TEST(model_manifest, ParsesVariants)
+{
+    auto path = std::filesystem::temp_directory_path() / "irpam_manifest_test.txt";
+    {
+        std::ofstream file(path);
+        file << "# Test models\n"
+             << "[small-fp16]\n"
+             << "role = embedder\n"
+             << "weights = small.onnx\n"
+             << "input = 96x112\n"
+             << "mean = 127.5, 127.5, 127.5\n"
+             << "precision = fp16\n"
+             << "accuracy = 0.97\n"
+             << "embedding_width = 512\n"
+             << "[detector]\n"
+             << "role = detector\n"
+             << "weights = /models/detector.caffemodel\n"
+             << "input = 300\n";
+    }
+
+    ModelManifest manifest = ModelManifest::load(path.string());
+    ASSERT_EQ(manifest.models.size(), 2u);
+
+    const ModelSpec &small = manifest.models[0];
+    EXPECT_EQ(small.weights, (path.parent_path() / "small.onnx").string());
+    EXPECT_EQ(small.input_width, 96);
+    EXPECT_EQ(small.input_height, 112);
+    EXPECT_DOUBLE_EQ(small.mean[2], 127.5);
+    EXPECT_EQ(small.precision, "fp16");
+    EXPECT_FLOAT_EQ(small.accuracy, 0.97f);
+
+    EXPECT_EQ(manifest.choose(ModelRole::Detector, "", 1.0).weights, "/models/detector.caffemodel");
+    EXPECT_EQ(manifest.choose(ModelRole::Embedder, "small-fp16", 1.0).name, "small-fp16");
+    EXPECT_THROW(manifest.choose(ModelRole::Embedder, "detector", 1.0), std::runtime_error);
+
+    // Embeddings of another width could never match the enrolled ones.
+    manifest.models[0].embedding_width = 128;
+    EXPECT_THROW(manifest.choose(ModelRole::Embedder, "small-fp16", 1.0), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST(model_manifest, FastestVariantMustReachTheAccuracyTarget)
+{
+    ModelManifest manifest = ModelManifest::builtin("/nonexistent");
+    EXPECT_EQ(manifest.variants(ModelRole::Embedder).front().outputs, (std::vector<std::string>{"fc1"}));
+
+    // Nothing is as accurate as the reference, and missing files never qualify.
+    EXPECT_THROW(select_fastest(manifest, ModelRole::Embedder, 1.5), std::runtime_error);
+    EXPECT_THROW(select_fastest(manifest, ModelRole::Detector, 0.5), std::runtime_error);
+}
+
+TEST(face_detector, DecoderComesFromTheSpec)
+{
+    ModelManifest manifest = ModelManifest::builtin("/nonexistent");
+    ModelSpec ssd = manifest.variants(ModelRole::Detector).front();
+    EXPECT_NE(dynamic_cast<SsdFaceDetector *>(FaceDetector::create(ssd).get()), nullptr);
+
+    ModelSpec yunet{.name = "yunet", .role = ModelRole::Detector, .input_width = 160, .input_height = 128, .decoder = "yunet"};
+    yunet.outputs = {"cls_8", "cls_16", "cls_32", "obj_8", "obj_16", "obj_32",
+                     "bbox_8", "bbox_16", "bbox_32", "kps_8", "kps_16", "kps_32"};
+    EXPECT_NE(dynamic_cast<YuNetFaceDetector *>(FaceDetector::create(yunet).get()), nullptr);
+
+    // YuNet needs its input padded to the largest stride, and all of its heads.
+    yunet.input_height = 120;
+    EXPECT_THROW(FaceDetector::create(yunet), std::runtime_error);
+    yunet.input_height = 128;
+    yunet.outputs.pop_back();
+    EXPECT_THROW(FaceDetector::create(yunet), std::runtime_error);
+
+    EXPECT_THROW(FaceDetector::create(manifest.variants(ModelRole::Embedder).front()), std::runtime_error);
+}
+
+TEST(face_detector, SuppressesOverlappingDetections)
+{
+    std::vector<DetectedFace> faces = {
+        DetectedFace{.x = 0, .y = 0, .w = 100, .h = 100, .size = 10000, .confidence = 0.9f},
+        DetectedFace{.x = 5, .y = 5, .w = 100, .h = 100, .size = 10000, .confidence = 0.95f},
+        DetectedFace{.x = 300, .y = 300, .w = 50, .h = 50, .size = 2500, .confidence = 0.85f},
+        DetectedFace{.x = 200, .y = 0, .w = 120, .h = 120, .size = 14400, .confidence = 0.81f}};
+
+    auto kept = non_max_suppression(faces, 0.3f);
+    ASSERT_EQ(kept.size(), 3u);
+    EXPECT_FLOAT_EQ(kept[0].confidence, 0.95f);
+    EXPECT_EQ(non_max_suppression(faces, 0).size(), faces.size());
+
+    // The least confident detection is not a candidate.
+    auto candidates = non_max_suppression(faces, 0.3f, 3);
+    ASSERT_EQ(candidates.size(), 2u);
+    EXPECT_FLOAT_EQ(candidates[1].confidence, 0.85f);
+
+    keep_largest(kept, 2);
+    ASSERT_EQ(kept.size(), 2u);
+    EXPECT_EQ(kept[0].size, 14400);
+    EXPECT_EQ(kept[1].size, 10000);
+
+    keep_largest(kept, 5);
+    EXPECT_EQ(kept.size(), 2u);
+}
+
+TEST(alignment, SimilarityTransformUndoesRotationAndScale)
+{
+    // The template, seen rotated by 30 degrees, twice as large and shifted.
+    float angle = CV_PI / 6;
+    std::vector<cv::Point2f> target(ARCFACE_TEMPLATE.begin(), ARCFACE_TEMPLATE.end());
+    std::vector<cv::Point2f> landmarks;
+    for (const auto &point : target)
+        landmarks.emplace_back(2 * (point.x * std::cos(angle) - point.y * std::sin(angle)) + 200,
+                               2 * (point.x * std::sin(angle) + point.y * std::cos(angle)) + 100);
+
+    cv::Matx23f transform = similarity_transform(landmarks, target);
+    for (size_t i = 0; i < target.size(); i++)
+    {
+        cv::Point2f mapped(transform(0, 0) * landmarks[i].x + transform(0, 1) * landmarks[i].y + transform(0, 2),
+                           transform(1, 0) * landmarks[i].x + transform(1, 1) * landmarks[i].y + transform(1, 2));
+        EXPECT_NEAR(mapped.x, target[i].x, 1e-3);
+        EXPECT_NEAR(mapped.y, target[i].y, 1e-3);
+    }
+
+    EXPECT_THROW(similarity_transform({landmarks[0], landmarks[0]}, {target[0], target[1]}), std::runtime_error);
+}
+
+TEST(alignment, AlignedFaceKeepsTheFrameLayout)
+{
+    cv::Mat frame(480, 640, CV_8UC1, cv::Scalar(90));
+    std::vector<cv::Point2f> landmarks;
+    for (const auto &point : ARCFACE_TEMPLATE)
+        landmarks.emplace_back(point.x * 2 + 250, point.y * 2 + 150);
+
+    cv::Mat aligned = align_face(frame, landmarks, EMBEDDING_NET_WIDTH, EMBEDDING_NET_WIDTH);
+    EXPECT_EQ(aligned.type(), CV_8UC1);
+    EXPECT_EQ(aligned.cols, EMBEDDING_NET_WIDTH);
+    EXPECT_EQ(aligned.rows, EMBEDDING_NET_WIDTH);
+    EXPECT_EQ(aligned.at<unsigned char>(56, 56), 90);
+}
+
+TEST(model_registry, ParsesCpuLists)
+{
+    EXPECT_EQ(InferenceConfig::parseCpuList("2,3"), (std::vector<int>{2, 3}));
+    EXPECT_EQ(InferenceConfig::parseCpuList("0-2, 6"), (std::vector<int>{0, 1, 2, 6}));
+    EXPECT_TRUE(InferenceConfig::parseCpuList("").empty());
+    EXPECT_THROW(InferenceConfig::parseCpuList("3-1"), std::runtime_error);
+}
+
+TEST(model_registry, InferenceConfigRejectsNegativeThreads)
+{
+    ModelRegistry &registry = ModelRegistry::getInstance();
+    EXPECT_THROW(registry.configureInference(InferenceConfig{.threads = -1}), std::runtime_error);
+
+    registry.configureInference(InferenceConfig{.threads = 2});
+    EXPECT_EQ(registry.getInferenceConfig().threads, 2);
+    registry.configureInference({});
+}
+
+TEST(model_registry, InferenceThreadLeavesTheCallerAlone)
+{
+    cpu_set_t caller;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(caller), &caller), 0);
+    int first = 0;
+    while (!CPU_ISSET(first, &caller))
+        first++;
+
+    InferenceThread thread(InferenceConfig{.cpus = {first}});
+    int pinned = 0;
+    thread.call([&pinned]()
+                {
+        cpu_set_t set;
+        sched_getaffinity(0, sizeof(set), &set);
+        pinned = CPU_COUNT(&set); });
+    EXPECT_EQ(pinned, 1);
+
+    cpu_set_t after;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(after), &after), 0);
+    EXPECT_TRUE(CPU_EQUAL(&caller, &after));
+
+    EXPECT_THROW(thread.call([]()
+                             { throw std::runtime_error("forward failed"); }),
+                 std::runtime_error);
+}
+
+TEST(embedding_store, RoundTrip)
+{
+    auto directory = std::filesystem::temp_directory_path() / "irpam_store_test";
+    std::filesystem::remove_all(directory);
+    EmbeddingStore store(directory.string());
+
+    EXPECT_FALSE(store.contains("alice"));
+    EXPECT_TRUE(store.load("alice").empty());
+
+    cv::Mat first(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(0.5));
+    cv::Mat second(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(-0.25));
+    store.append("alice", first);
+    store.append("alice", second);
+
+    cv::Mat loaded = store.load("alice");
+    ASSERT_EQ(loaded.rows, 2);
+    ASSERT_EQ(loaded.cols, EMBEDDING_WIDTH);
+    EXPECT_EQ(cv::norm(loaded.row(0), first), 0);
+    EXPECT_EQ(cv::norm(loaded.row(1), second), 0);
+
+    // A live embedding identical to an enrolled sample is a perfect match.
+    EXPECT_FLOAT_EQ(best_similarity(second, loaded), 1.0f);
+
+    EXPECT_ANY_THROW(store.pathFor("../etc/passwd"));
+
+    store.remove("alice");
+    EXPECT_FALSE(store.contains("alice"));
+    std::filesystem::remove_all(directory);
+}
+
+TEST(embedding_store, RejectsCountsLargerThanTheFile)
+{
+    auto directory = std::filesystem::temp_directory_path() / "irpam_store_count_test";
+    std::filesystem::remove_all(directory);
+    EmbeddingStore store(directory.string());
+    store.save("alice", cv::Mat(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(0.5)));
+
+    // Claim four billion embeddings, with one on disk.
+    {
+        std::fstream file(store.pathFor("alice"), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(12);
+        uint32_t count = 0xffffffff;
+        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    }
+    EXPECT_THROW(store.load("alice"), std::runtime_error);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(embedding_store, RejectsSamplesOfOtherModels)
+{
+    auto directory = std::filesystem::temp_directory_path() / "irpam_store_origin_test";
+    std::filesystem::remove_all(directory);
+    EmbeddingOrigin cropped{.embedder = "arcface", .preparation = FacePreparation::Cropped};
+    EmbeddingStore(directory.string(), cropped).save("alice", cv::Mat(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(0.5)));
+
+    EXPECT_EQ(EmbeddingStore(directory.string(), cropped).load("alice").rows, 1);
+
+    EmbeddingOrigin aligned{.embedder = "arcface", .preparation = FacePreparation::Aligned};
+    EXPECT_THROW(EmbeddingStore(directory.string(), aligned).load("alice"), std::runtime_error);
+    EmbeddingOrigin other{.embedder = "arcface-int8", .preparation = FacePreparation::Cropped};
+    EXPECT_THROW(EmbeddingStore(directory.string(), other).load("alice"), std::runtime_error);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(embedding_matcher, KernelsAgree)
+{
+    cv::Mat enrolled(8, EMBEDDING_WIDTH, CV_32F);
+    for (int i = 0; i < enrolled.rows; i++)
+        for (int j = 0; j < EMBEDDING_WIDTH; j++)
+            enrolled.at<float>(i, j) = static_cast<float>((i * 31 + j * 17) % 23) - 11.0f;
+
+    cv::Mat probe = enrolled.row(5).clone() * 3.0;
+
+    MatchResult scalar = EmbeddingMatcher(enrolled, MatcherKernel::Scalar).best(probe);
+    EXPECT_EQ(scalar.index, 5);
+    EXPECT_NEAR(scalar.score, 1.0f, 1e-5);
+
+    MatchResult dispatched = EmbeddingMatcher(enrolled).best(probe);
+    EXPECT_EQ(dispatched.index, scalar.index);
+    EXPECT_NEAR(dispatched.score, scalar.score, 1e-5);
+
+    EXPECT_EQ(EmbeddingMatcher(EMBEDDING_WIDTH).best(probe).index, -1);
+}
+
+TEST(embedding_matcher, AlwaysPicksARow)
+{
+    cv::Mat enrolled(2, EMBEDDING_WIDTH, CV_32F, cv::Scalar(1.0f));
+    EmbeddingMatcher matcher(enrolled);
+
+    // A probe opposite to every row still matches one, with the lowest score.
+    MatchResult opposite = matcher.best(cv::Mat(1, EMBEDDING_WIDTH, CV_32F, cv::Scalar(-2.0f)));
+    EXPECT_EQ(opposite.index, 0);
+    EXPECT_NEAR(opposite.score, -1.0f, 1e-5);
+
+    MatchResult zero = matcher.best(cv::Mat::zeros(1, EMBEDDING_WIDTH, CV_32F));
+    EXPECT_EQ(zero.index, 0);
+    EXPECT_EQ(zero.score, 0.0f);
+
+    if (EmbeddingMatcher::bestKernel() < MatcherKernel::AVX512)
+        EXPECT_THROW(EmbeddingMatcher(EMBEDDING_WIDTH, MatcherKernel::AVX512), std::runtime_error);
 }
 
 TEST(ir_capture, IR) {
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <vector>
+#include "iremitter.hpp"
+#include "replaysource.hpp"
+
+static std::string write_recording(const std::string &name, int frames)
+{
+    auto path = (std::filesystem::temp_directory_path() / name).string();
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 8, 4);
+
+    RawCaptureWriter writer(path, format);
+    for (int i = 0; i < frames; i++)
+    {
+        std::vector<unsigned char> pixels(format.buffersize, static_cast<unsigned char>(i * 10));
+        writer.write(ImageBuffer(pixels.data(), pixels.size(), format));
+    }
+    return path;
+}
+
+TEST(replay, RawCapturePlaysBackInOrder)
+{
+    auto path = write_recording("irpam_replay_test.raw", 3);
+    ReplaySource source(path);
+    auto stream = source.open({});
+
+    EXPECT_EQ(stream->getFormat().layout, PixelLayout::Grey);
+    for (int i = 0; i < 3; i++)
+    {
+        auto frame = stream->next();
+        ASSERT_EQ(frame->getSize(), 32u);
+        EXPECT_EQ(static_cast<const unsigned char *>(frame->getData())[0], i * 10);
+    }
+    EXPECT_THROW(stream->next(), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST(replay, LoopsAndKeepsPace)
+{
+    auto path = write_recording("irpam_replay_loop.raw", 2);
+    ReplaySource source(path, std::chrono::milliseconds(10), true);
+    auto stream = source.open({});
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 5; i++)
+    {
+        auto frame = stream->next();
+        EXPECT_EQ(static_cast<const unsigned char *>(frame->getData())[0], (i % 2) * 10);
+    }
+    // The first frame is due immediately, the other four wait one interval each.
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(40));
+
+    std::filesystem::remove(path);
+}
+
+TEST(replay, LitFramesOfAnAlternatingEmitter)
+{
+    // Every other frame of the recording was taken with the emitter off.
+    auto path = (std::filesystem::temp_directory_path() / "irpam_replay_emitter.raw").string();
+    auto format = ImageFormat::fromFourcc(V4L2_PIX_FMT_GREY, 16, 8);
+    {
+        RawCaptureWriter writer(path, format);
+        for (int i = 0; i < 6; i++)
+        {
+            std::vector<unsigned char> pixels(format.buffersize, i % 2 == 0 ? 200 : 40);
+            writer.write(ImageBuffer(pixels.data(), pixels.size(), format));
+        }
+    }
+
+    LitFrameStream stream(ReplaySource(path).open({}));
+    for (int i = 0; i < 3; i++)
+    {
+        auto frame = stream.next();
+        EXPECT_EQ(static_cast<const unsigned char *>(frame->getData())[0], 200);
+        // The gate further down reuses the measurement.
+        ASSERT_NE(frame->getQuality(), nullptr);
+        EXPECT_DOUBLE_EQ(frame->getQuality()->mean, 200);
+    }
+    EXPECT_EQ(stream.getStats().frames, 5);
+    EXPECT_EQ(stream.getStats().dropped, 2);
+
+    std::filesystem::remove(path);
+}
+
+TEST(replay, LitFramesKeepsASteadyStream)
+{
+    auto path = write_recording("irpam_replay_steady.raw", 4);
+    LitFrameStream stream(ReplaySource(path).open({}));
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(static_cast<const unsigned char *>(stream.next()->getData())[0], i * 10);
+    EXPECT_EQ(stream.getStats().dropped, 0);
+
+    std::filesystem::remove(path);
+}
+
+// A camera that only delivers MJPEG, which cannot be measured before it is decoded.
+class EncodedStream : public FrameStream
+{
+private:
+    ImageFormat format = ImageFormat::fromFourcc(V4L2_PIX_FMT_MJPEG, 64, 48);
+
+public:
+    const ImageFormat &getFormat() const override { return format; }
+
+    std::unique_ptr<ImageBuffer> next() override
+    {
+        std::vector<unsigned char> jpeg(16, 0xff);
+        return std::make_unique<ImageBuffer>(jpeg.data(), jpeg.size(), format);
+    }
+};
+
+TEST(replay, LitFramesPassesEncodedFrames)
+{
+    LitFrameStream stream(std::make_unique<EncodedStream>());
+    for (int i = 0; i < 3; i++)
+        EXPECT_FALSE(stream.next()->getQuality()->valid);
+    EXPECT_EQ(stream.getStats().dropped, 0);
+}
+
+TEST(replay, MissingRecordingThrows)
+{
+    EXPECT_THROW(ReplaySource("/nonexistent/recording.raw"), std::runtime_error);
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "trace.hpp"
+
+TEST(trace, DisabledRecordsNothing)
+{
+    Tracer &tracer = Tracer::getInstance();
+    tracer.enable(false);
+    tracer.clear();
+
+    {
+        TRACE_SCOPE("test.disabled");
+    }
+    EXPECT_TRUE(tracer.snapshot().empty());
+}
+
+TEST(trace, ScopesAreRecordedInOrder)
+{
+    Tracer &tracer = Tracer::getInstance();
+    tracer.enable();
+    tracer.clear();
+
+    {
+        TRACE_SCOPE("test.outer");
+        TRACE_SCOPE("test.inner");
+    }
+    tracer.enable(false);
+
+    auto events = tracer.snapshot();
+    ASSERT_EQ(events.size(), 2u);
+    // Inner scopes finish first.
+    EXPECT_STREQ(events[0].name, "test.inner");
+    EXPECT_STREQ(events[1].name, "test.outer");
+    EXPECT_GE(events[1].duration_ns, events[0].duration_ns);
+}
+
+TEST(trace, RingBufferKeepsNewestEvents)
+{
+    Tracer &tracer = Tracer::getInstance();
+    tracer.clear();
+    for (int i = 0; i < 5000; i++)
+        tracer.record(i < 4999 ? "test.old" : "test.newest", 0, 1);
+
+    auto events = tracer.snapshot();
+    EXPECT_EQ(events.size(), 4096u);
+    EXPECT_STREQ(events.back().name, "test.newest");
+    tracer.clear();
+}
+
+TEST(trace, WritesChromeTrace)
+{
+    Tracer &tracer = Tracer::getInstance();
+    tracer.clear();
+    // Three hours of uptime: two spans 5ms apart must not print the same timestamp.
+    const uint64_t uptime_ns = 3ull * 3600 * 1000 * 1000 * 1000;
+    tracer.record("test.chrome", uptime_ns, uptime_ns + 2000);
+    tracer.record("test.chrome", uptime_ns + 5000000, uptime_ns + 5002500);
+
+    auto path = (std::filesystem::temp_directory_path() / "irpam_trace_test.json").string();
+    tracer.writeChromeTrace(path);
+
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    EXPECT_NE(contents.str().find("\"name\":\"test.chrome\""), std::string::npos);
+    EXPECT_NE(contents.str().find("\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(contents.str().find("\"ts\":10800000000.000,\"dur\":2.000"), std::string::npos);
+    EXPECT_NE(contents.str().find("\"ts\":10800005000.000,\"dur\":2.500"), std::string::npos);
+
+    std::filesystem::remove(path);
+    tracer.clear();
+}
+
+TEST(trace, DoesNotWriteThroughSymlinks)
+{
+    auto directory = std::filesystem::temp_directory_path();
+    auto target = directory / "irpam_trace_target.txt";
+    auto link = directory / "irpam_trace_link.json";
+    std::filesystem::remove(link);
+    {
+        std::ofstream file(target);
+        file << "precious";
+    }
+    std::filesystem::create_symlink(target, link);
+
+    EXPECT_THROW(Tracer::getInstance().writeChromeTrace(link.string()), std::runtime_error);
+
+    std::ifstream file(target);
+    std::string contents;
+    file >> contents;
+    EXPECT_EQ(contents, "precious");
+
+    std::filesystem::remove(link);
+    std::filesystem::remove(target);
+}